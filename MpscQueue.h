@@ -0,0 +1,244 @@
+#ifndef MPSC_QUEUE_H
+#define MPSC_QUEUE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <iterator>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include "SpscQueue.h"
+
+namespace sq{
+
+    // 多生产者单消费者的扇入队列：每个生产者线程第一次入队时登记一条自己的 ReaderWriterQueue 通道，
+    // 之后的入队都走这条通道的无锁 SPSC 快速路径，生产者之间不共享任何会被写的缓存行。
+    // 唯一的消费者从上次停下的通道开始轮询，每条通道每轮最多取 laneBatch 个元素，保证各生产者公平。
+    // 生产者线程退出时只做标记，退出的线程留下的元素仍然会被消费；消费者发现通道已取空后回收它，
+    // 槽位可以给新的线程使用，所以 MAX_LANES 限制的是同时存在（或尚未取空）的生产者数量
+    template<typename T, size_t MAX_LANES = 64, size_t MAX_BLOCK_SIZE = 512, typename Ordering = DefaultOrdering, typename Allocator = MallocBlockAllocator>
+    class FanInQueue
+    {
+        public:
+            using Lane = ReaderWriterQueue<T, MAX_BLOCK_SIZE, Ordering, Allocator>;
+
+            explicit FanInQueue(size_t _laneSize = 15, size_t _laneBatch = 64, const Allocator& _allocator = Allocator())
+                : id(instanceCounter.fetch_add(1, std::memory_order_relaxed)), laneSize(_laneSize), laneBatch(_laneBatch), allocator(_allocator)
+            {
+                assert(laneBatch >= 1);
+            }
+
+            FanInQueue(const FanInQueue&) = delete;
+            FanInQueue& operator=(const FanInQueue&) = delete;
+
+            ~FanInQueue()
+            {
+                for (auto& slot : lanes) {
+                    LaneRecord* record = slot.load(std::memory_order_acquire);
+                    if (record == nullptr) continue;
+                    record->queueClosed.store(true, std::memory_order_release);
+                    record->release();
+                }
+            }
+
+            // 以下入队接口可以由任意线程调用，语义与 ReaderWriterQueue 的同名接口相同。
+            // 登记通道时 MAX_LANES 个槽位都被占用会抛出 std::length_error
+            template<typename U>
+            bool try_enqueue(U&& element) {return local_lane().try_enqueue(std::forward<U>(element));}
+
+            template<typename U>
+            bool enqueue(U&& element) {return local_lane().enqueue(std::forward<U>(element));}
+
+            template<typename... Args>
+            bool try_emplace(Args&&... args) {return local_lane().try_emplace(std::forward<Args>(args)...);}
+
+            template<typename... Args>
+            bool emplace(Args&&... args) {return local_lane().emplace(std::forward<Args>(args)...);}
+
+            template<typename It>
+            bool try_enqueue_bulk(It first, size_t count) {return local_lane().try_enqueue_bulk(first, count);}
+
+            template<typename It>
+            bool enqueue_bulk(It first, size_t count) {return local_lane().enqueue_bulk(first, count);}
+
+            // 以下出队接口只能由唯一的消费者调用。每个生产者各自保持 FIFO，不同生产者之间没有顺序保证
+            template<typename U>
+            bool try_dequeue(U& result)
+            {
+                size_t count = registered_lanes();
+                for (size_t visited = 0; visited != count; ++visited) {
+                    size_t index = cursor;
+                    if (++cursor >= count) cursor = 0;
+                    LaneRecord* record = lanes[index].load(std::memory_order_acquire);
+                    if (record == nullptr) continue;
+                    if (record->lane.try_dequeue(result)) return true;
+                    reclaim_if_drained(index, record);
+                }
+                return false;
+            }
+
+            // 轮询一圈，每条通道最多取 laneBatch 个，凑满 max 个或所有通道都看过一遍后返回实际出队数量
+            template<typename It>
+            size_t try_dequeue_bulk(It out, size_t max)
+            {
+                size_t count = registered_lanes();
+                size_t total = 0;
+                for (size_t visited = 0; visited != count && total != max; ++visited) {
+                    size_t index = cursor;
+                    if (++cursor >= count) cursor = 0;
+                    LaneRecord* record = lanes[index].load(std::memory_order_acquire);
+                    if (record == nullptr) continue;
+
+                    size_t n = record->lane.try_dequeue_bulk(out, std::min(laneBatch, max - total));
+                    if (n == 0) reclaim_if_drained(index, record);
+                    std::advance(out, n);
+                    total += n;
+                }
+                return total;
+            }
+
+            [[nodiscard]] size_t size_approx() const
+            {
+                size_t result = 0;
+                size_t count = registered_lanes();
+                for (size_t i = 0; i != count; ++i) {
+                    LaneRecord* record = lanes[i].load(std::memory_order_acquire);
+                    if (record != nullptr) result += record->lane.size_approx();
+                }
+                return result;
+            }
+
+            // 当前占用槽位的通道数（包括生产者已退出、尚未被消费者取空回收的通道）
+            [[nodiscard]] size_t lane_count() const
+            {
+                size_t result = 0;
+                size_t count = registered_lanes();
+                for (size_t i = 0; i != count; ++i) {
+                    if (lanes[i].load(std::memory_order_acquire) != nullptr) ++result;
+                }
+                return result;
+            }
+
+        private:
+            // 通道由队列和登记它的线程共同持有，两边各占一个引用，后释放的一方负责删除。
+            // 线程退出时设置 producerExited，队列析构时设置 queueClosed
+            struct LaneRecord
+            {
+                LaneRecord(size_t size, const Allocator& allocator) : lane(size, allocator) {}
+
+                void release()
+                {
+                    if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) delete this;
+                }
+
+                Lane lane;
+                std::atomic<bool> producerExited{false};
+                std::atomic<bool> queueClosed{false};
+                std::atomic<int> refs{2};
+            };
+
+            // 每个线程一份的通道表，按队列 id 哈希查找，并缓存最近一次命中的条目。
+            // 线程退出时析构，通知每个仍存活的队列：这条通道不会再有新元素
+            struct ThreadLanes
+            {
+                ~ThreadLanes()
+                {
+                    for (auto& entry : records) {
+                        entry.second->producerExited.store(true, std::memory_order_release);
+                        entry.second->release();
+                    }
+                }
+
+                LaneRecord* find(std::uint64_t queueId)
+                {
+                    if (lastRecord != nullptr && lastId == queueId) return lastRecord;
+                    auto it = records.find(queueId);
+                    if (it == records.end()) return nullptr;
+                    lastId = queueId;
+                    lastRecord = it->second;
+                    return lastRecord;
+                }
+
+                // 登记新通道时顺便丢掉已经析构的队列留下的条目，表的大小不会随用过的队列数无限增长
+                void insert(std::uint64_t queueId, LaneRecord* record)
+                {
+                    for (auto it = records.begin(); it != records.end();) {
+                        if (it->second->queueClosed.load(std::memory_order_acquire)) {
+                            it->second->release();
+                            it = records.erase(it);
+                        } else {
+                            ++it;
+                        }
+                    }
+                    records.emplace(queueId, record);
+                    lastId = queueId;
+                    lastRecord = record;
+                }
+
+                std::unordered_map<std::uint64_t, LaneRecord*> records;
+                std::uint64_t lastId{0};
+                LaneRecord* lastRecord{nullptr};
+            };
+
+            size_t registered_lanes() const {return std::min(laneCount.load(std::memory_order_acquire), MAX_LANES);}
+
+            // 生产者退出之后通道不会再有新元素：acquire 读到标记后再确认一次为空，就可以清空槽位并释放队列持有的引用。
+            // 只由消费者调用
+            void reclaim_if_drained(size_t index, LaneRecord* record)
+            {
+                if (!record->producerExited.load(std::memory_order_acquire)) return;
+                if (record->lane.peek() != nullptr) return;
+
+                lanes[index].store(nullptr, std::memory_order_release);
+                record->release();
+            }
+
+            // 线程第一次访问这个队列时登记通道：先构造通道，再用 CAS 占据第一个空槽位发布出去，
+            // 消费者遍历的范围 laneCount 只增不减。队列 id 不会复用，线程缓存里过期的条目不会被误用
+            Lane& local_lane()
+            {
+                thread_local ThreadLanes cache;
+                if (LaneRecord* record = cache.find(id)) return record->lane;
+
+                auto record = new LaneRecord(laneSize, allocator);
+                size_t index = 0;
+                for (; index != MAX_LANES; ++index) {
+                    LaneRecord* expected = nullptr;
+                    if (lanes[index].load(std::memory_order_relaxed) == nullptr &&
+                        lanes[index].compare_exchange_strong(expected, record, std::memory_order_acq_rel)) break;
+                }
+                if (index == MAX_LANES) {
+                    delete record;
+                    throw std::length_error("FanInQueue: too many producer threads");
+                }
+
+                size_t count = laneCount.load(std::memory_order_relaxed);
+                while (count < index + 1 && !laneCount.compare_exchange_weak(count, index + 1, std::memory_order_release)) {}
+
+                try {
+                    cache.insert(id, record);
+                } catch (...) {
+                    // 线程表登记失败时把通道交还给队列：标记为已退出，消费者会在取空后回收
+                    record->producerExited.store(true, std::memory_order_release);
+                    record->release();
+                    throw;
+                }
+                return record->lane;
+            }
+
+            static inline std::atomic<std::uint64_t> instanceCounter{1};  // 0 留给线程表的空缓存
+
+            const std::uint64_t id;
+            const size_t laneSize;
+            const size_t laneBatch;
+            const Allocator allocator;
+
+            std::atomic<LaneRecord*> lanes[MAX_LANES]{};
+            alignas(CACHE_LINE_SIZE) std::atomic<size_t> laneCount{0};  // 曾经用过的最大槽位下标加一，只在登记通道时修改
+            alignas(CACHE_LINE_SIZE) size_t cursor{0};  // 消费者下一次从这条通道开始轮询
+    };
+
+}
+
+#endif
@@ -7,7 +7,14 @@
 #include <condition_variable>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <type_traits>
+#include <new>
+#include <utility>
 
 class QueueEmptyError final: public std::exception
 {
@@ -17,86 +24,283 @@ class QueueEmptyError final: public std::exception
     }
 };
 
+// 事件计数：等待者数量和通知轮次打包在同一个 64 位原子量里（低 32 位是等待者数，高 32 位是轮次）。
+// 等待方先 prepare_wait 登记并取得当前轮次，再检查一次条件，条件仍不满足才 wait；
+// 通知方在发布数据之后调用 notify，没有等待者时只有一次 fence 和一次读，不写共享变量也不进内核。
+// 有等待者时推进轮次并唤醒，唤醒走互斥量加条件变量，只在确实有线程睡眠时才会发生
+class EventCount
+{
+public:
+    using Key = std::uint32_t;
+
+    EventCount() = default;
+    EventCount(const EventCount&) = delete;
+    EventCount& operator=(const EventCount&) = delete;
+
+    // 登记为等待者。之后的 fence 与 notify 里的 fence 配对：要么等待方看到新数据，要么通知方看到等待者
+    Key prepare_wait()
+    {
+        std::uint64_t prev = _state.fetch_add(WAITER_INC, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return static_cast<Key>(prev >> EPOCH_SHIFT);
+    }
+
+    // 再次检查发现条件已经满足，不再睡眠
+    void cancel_wait()
+    {
+        _state.fetch_sub(WAITER_INC, std::memory_order_relaxed);
+    }
+
+    // 睡到轮次不再是 key 为止，返回后调用者需要重新检查条件
+    void wait(Key key)
+    {
+        {
+            std::unique_lock<std::mutex> lock(_mtx);
+            _cv.wait(lock, [this, key]() {
+                return static_cast<Key>(_state.load(std::memory_order_acquire) >> EPOCH_SHIFT) != key;
+            });
+        }
+        _state.fetch_sub(WAITER_INC, std::memory_order_relaxed);
+    }
+
+    // 最多唤醒 n 个等待者
+    void notify(std::size_t n)
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        std::uint64_t state = _state.load(std::memory_order_relaxed);
+        std::size_t waiters = static_cast<std::size_t>(state & WAITER_MASK);
+        if(waiters == 0 || n == 0) return;
+
+        _state.fetch_add(EPOCH_INC, std::memory_order_acq_rel);
+        // 等待方在 _mtx 里检查轮次，这里先进出一次 _mtx，保证检查过旧轮次的线程已经睡下，通知不会丢
+        {
+            std::lock_guard<std::mutex> lock(_mtx);
+        }
+        if(n >= waiters) _cv.notify_all();
+        else while(n--) _cv.notify_one();
+    }
+
+    void notify_one() {notify(1);}
+    void notify_all() {notify(static_cast<std::size_t>(WAITER_MASK));}
+
+private:
+    static constexpr unsigned EPOCH_SHIFT = 32;
+    static constexpr std::uint64_t WAITER_INC = 1;
+    static constexpr std::uint64_t WAITER_MASK = (std::uint64_t(1) << EPOCH_SHIFT) - 1;
+    static constexpr std::uint64_t EPOCH_INC = std::uint64_t(1) << EPOCH_SHIFT;
+
+    std::atomic<std::uint64_t> _state{0};
+    std::mutex _mtx;
+    std::condition_variable _cv;
+};
+
 // 实现一个细粒度锁的FIFO队列， 头出、尾进
 // 暂时定义为nocopyable，固定头节点为虚拟节点
+// 元素直接存放在节点里，出队后的节点放回队列自己的空闲链表，稳定状态下 push/pop 不调用全局分配器
+// 只有生产者修改 _tail，写完元素后以 release 发布；消费者以 acquire 读取 _tail 判断是否为空，出队从不获取 _tail_mtx。
+// 两把锁和首尾指针各占一个缓存行，生产者和消费者之间只通过 _tail 和节点本身通信。
+// 阻塞出队通过 EventCount 等待，消费者都醒着时 push 不会唤醒任何线程
 template <typename T>
 class Queue
 {
 private:
+    static constexpr std::size_t CACHE_LINE = 64;
+
     struct Node
     {
-        std::shared_ptr<T> data;
-        std::unique_ptr<Node> next;
+        std::optional<T> data;
+        Node* next{nullptr};
     };
 
 public:
-    Queue(): _head(new Node), _tail(_head.get()){}
-    ~Queue() = default;
-    void push(const T& v)
+    Queue(): _head(new Node), _tail(_head){}
+
+    ~Queue()
+    {
+        while(_head)
+        {
+            Node* next = _head->next;
+            delete _head;
+            _head = next;
+        }
+
+        Node* node = _free.load(std::memory_order_relaxed);
+        while(node)
+        {
+            Node* next = node->next;
+            delete node;
+            node = next;
+        }
+    }
+
+    Queue(const Queue&) = delete;
+    Queue& operator=(const Queue&) = delete;
+
+    void push(const T& v) {emplace(v);}
+    void push(T&& v) {emplace(std::move(v));}
+
+    // 元素构造抛出时队列不变
+    template <typename... Args>
+    void emplace(Args&&... args)
     {
-        auto data = std::make_shared<T>(v);
-        auto new_tail = std::make_unique<Node>();
         {
             std::lock_guard<std::mutex> lock_tail(_tail_mtx);
-            _tail->data = data;
-            _tail->next = std::move(new_tail);
-            _tail = new_tail.get();
+            Node* new_tail = append_locked(_tail.load(std::memory_order_relaxed), std::forward<Args>(args)...);
+            _tail.store(new_tail, std::memory_order_release);
         }
-        _cv.notify_one();
+        _event.notify_one();
     }
 
-    std::shared_ptr<T> pop()
+    // 一次加锁入队 [first, last)，之后一次性唤醒最多同样数量的等待者。
+    // 某个元素构造抛出时，它之前的元素照常入队，然后重新抛出
+    template <typename It>
+    void push_bulk(It first, It last)
     {
-        // get_tail需要放在_head_mtx里，因为放在外部可能会被其他线程Pop掉
-        std::lock_guard<std::mutex> lock_head(_head_mtx);
-        if(_head.get() == get_tail()) return std::make_shared<T>();
+        std::size_t count = 0;
+        std::exception_ptr error;
+        {
+            std::lock_guard<std::mutex> lock_tail(_tail_mtx);
+            Node* last_node = _tail.load(std::memory_order_relaxed);
+            try
+            {
+                for(; first != last; ++first, ++count)
+                {
+                    last_node = append_locked(last_node, *first);
+                }
+            }
+            catch(...)
+            {
+                error = std::current_exception();
+            }
+            if(count != 0) _tail.store(last_node, std::memory_order_release);
+        }
+        if(count != 0) _event.notify(count);
+        if(error) std::rethrow_exception(error);
+    }
 
-        auto old_head = std::move(_head);
-        _head = std::move(old_head->next);
-        return old_head->data;
+    // 队列为空时返回 std::nullopt
+    std::optional<T> pop()
+    {
+        Node* old_head;
+        {
+            std::lock_guard<std::mutex> lock_head(_head_mtx);
+            if(empty_locked()) return std::nullopt;
+            old_head = pop_head();
+        }
+        std::optional<T> res = std::move(old_head->data);
+        recycle_node(old_head);
+        return res;
     }
 
     bool pop(T& t)
     {
-        std::lock_guard<std::mutex> lock_head(_head_mtx);
-        if(_head.get() == get_tail()) return false;
-        auto old_head = std::move(_head);
-        _head = std::move(old_head->next);
-        t = *(old_head->data);
+        Node* old_head;
+        {
+            std::lock_guard<std::mutex> lock_head(_head_mtx);
+            if(empty_locked()) return false;
+            old_head = pop_head();
+        }
+        t = std::move(*old_head->data);
+        recycle_node(old_head);
         return true;
     }
 
-    std::shared_ptr<T> wait_pop()
+    T wait_pop()
     {
-        std::unique_lock<std::mutex> lock_head(_head_mtx);
-        _cv.wait(_head_mtx, [this]() {return _head.get() != get_tail();});
-        auto old_head = std::move(_head);
-        _head = std::move(old_head->next);
-        return old_head->data;
+        Node* old_head = wait_pop_node();
+        T res = std::move(*old_head->data);
+        recycle_node(old_head);
+        return res;
     }
 
     void wait_pop(T &t)
     {
-        std::unique_lock<std::mutex> lock_head(_head_mtx);
-        _cv.wait(_head_mtx, [this]() {return _head.get() != get_tail();});
-        auto old_head = std::move(_head);
-        _head = std::move(old_head->next);
-        t = std::move(*(old_head->data));
+        Node* old_head = wait_pop_node();
+        t = std::move(*old_head->data);
+        recycle_node(old_head);
     }
 
 private:
-    Node* get_tail()
+    // 持有 _head_mtx 时调用，_head 不会被其他消费者移动；acquire 读到新的 _tail 后，_head 节点的元素和 next 都已写好
+    bool empty_locked() const
+    {
+        return _head == _tail.load(std::memory_order_acquire);
+    }
+
+    // 睡眠时不持有 _head_mtx，其他消费者可以继续 pop
+    Node* wait_pop_node()
+    {
+        while(true)
+        {
+            {
+                std::lock_guard<std::mutex> lock_head(_head_mtx);
+                if(!empty_locked()) return pop_head();
+            }
+
+            EventCount::Key key = _event.prepare_wait();
+            bool empty;
+            {
+                std::lock_guard<std::mutex> lock_head(_head_mtx);
+                empty = empty_locked();
+            }
+            if(empty) _event.wait(key);
+            else _event.cancel_wait();
+        }
+    }
+
+    // 持有 _head_mtx 且队列非空时调用，摘下的节点由调用者取走元素并回收
+    Node* pop_head()
+    {
+        Node* old_head = _head;
+        _head = old_head->next;
+        return old_head;
+    }
+
+    // 持有 _tail_mtx 时调用：先在尾节点上构造元素，再取一个空节点接在后面作为新的尾节点，返回新尾节点。
+    // 任一步抛出时尾节点的元素被清空，也没有节点离开空闲链表
+    template <typename... Args>
+    Node* append_locked(Node* tail, Args&&... args)
+    {
+        tail->data.emplace(std::forward<Args>(args)...);
+        Node* new_tail;
+        try
+        {
+            new_tail = acquire_node();
+        }
+        catch(...)
+        {
+            tail->data.reset();
+            throw;
+        }
+        tail->next = new_tail;
+        return new_tail;
+    }
+
+    // 空闲链表是一个无锁栈：取节点只在持有 _tail_mtx 时发生，同一时刻只有一个线程弹栈，
+    // 栈顶节点不会在读取它的 next 之后被别人弹出再压回，因此没有 ABA 问题；放回可以由任意线程并发进行
+    Node* acquire_node()
+    {
+        Node* node = _free.load(std::memory_order_acquire);
+        while(node && !_free.compare_exchange_weak(node, node->next, std::memory_order_acquire, std::memory_order_acquire)){}
+        if(!node) return new Node;
+        node->next = nullptr;
+        return node;
+    }
+
+    void recycle_node(Node* node)
     {
-        std::lock_guard<std::mutex> lock_head(_tail_mtx);
-        return _tail;
+        node->data.reset();
+        node->next = _free.load(std::memory_order_relaxed);
+        while(!_free.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed)){}
     }
 
 private:
-    std::mutex _head_mtx;
-    std::mutex _tail_mtx;
-    std::condition_variable _cv;
-    std::unique_ptr<Node> _head;
-    Node* _tail;
+    alignas(CACHE_LINE) std::mutex _head_mtx;
+    alignas(CACHE_LINE) Node* _head;
+    alignas(CACHE_LINE) std::mutex _tail_mtx;
+    alignas(CACHE_LINE) std::atomic<Node*> _tail;
+    alignas(CACHE_LINE) std::atomic<Node*> _free{nullptr};
+    alignas(CACHE_LINE) EventCount _event;
 };
 
 
@@ -152,38 +356,118 @@ private:
 
 
 
+// 双字原子：x86-64 上 GCC 把 16 字节的 std::atomic 交给 libatomic，is_lock_free() 报告 false，
+// 加了 -mcx16 也不会内联。打开 -mcx16 时（__GCC_HAVE_SYNC_COMPARE_AND_SWAP_16）直接用 __sync 内建函数生成 lock cmpxchg16b，
+// 读也通过一次比较交换完成；其他平台退回 std::atomic。
+// T 必须是 16 字节、可平凡复制且没有填充字节，否则比较时会把填充也算进去
+#if defined(__x86_64__) && defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_16)
+template <typename T>
+class DoubleWordAtomic
+{
+    static_assert(sizeof(T) == 16 && std::is_trivially_copyable<T>::value, "DoubleWordAtomic requires a 16-byte trivially copyable type");
+    using Word = unsigned __int128;
+
+public:
+    static constexpr bool is_always_lock_free = true;
+
+    DoubleWordAtomic() noexcept : _value(0) {}
+    explicit DoubleWordAtomic(const T& t) noexcept : _value(to_word(t)) {}
+    DoubleWordAtomic(const DoubleWordAtomic&) = delete;
+    DoubleWordAtomic& operator=(const DoubleWordAtomic&) = delete;
+
+    // 这一分支总是内联 lock cmpxchg16b；退回 std::atomic 的分支报告的是 std::atomic 自己的结果
+    [[nodiscard]] bool is_lock_free() const noexcept {return is_always_lock_free;}
+
+    // lock cmpxchg16b 本身是全屏障，内存序参数只为与 std::atomic 保持同样的接口
+    T load(std::memory_order = std::memory_order_seq_cst) const noexcept
+    {
+        return from_word(__sync_val_compare_and_swap(&_value, Word(0), Word(0)));
+    }
+
+    void store(const T& t, std::memory_order = std::memory_order_seq_cst) noexcept
+    {
+        Word desired = to_word(t);
+        Word old = 0;
+        Word prev;
+        while ((prev = __sync_val_compare_and_swap(&_value, old, desired)) != old) old = prev;
+    }
+
+    bool compare_exchange_strong(T& expected, const T& desired,
+        std::memory_order = std::memory_order_seq_cst, std::memory_order = std::memory_order_seq_cst) noexcept
+    {
+        Word old = to_word(expected);
+        Word prev = __sync_val_compare_and_swap(&_value, old, to_word(desired));
+        if (prev == old) return true;
+        expected = from_word(prev);
+        return false;
+    }
+
+    bool compare_exchange_weak(T& expected, const T& desired,
+        std::memory_order success = std::memory_order_seq_cst, std::memory_order failure = std::memory_order_seq_cst) noexcept
+    {
+        return compare_exchange_strong(expected, desired, success, failure);
+    }
+
+private:
+    static Word to_word(const T& t) noexcept
+    {
+        Word w;
+        std::memcpy(&w, &t, sizeof(w));
+        return w;
+    }
+
+    static T from_word(Word w) noexcept
+    {
+        T t;
+        std::memcpy(&t, &w, sizeof(t));
+        return t;
+    }
+
+    alignas(16) mutable Word _value;
+};
+#else
+template <typename T>
+using DoubleWordAtomic = std::atomic<T>;
+#endif
+
+
+// 无锁队列，多生产者、多消费者，采用分离引用计数
+// 外部计数跟随 _head、_tail 和前驱节点的 next 指针一起做双字 CAS，内部计数与外部计数器的个数打包在节点里。
+// 每个节点最多被两个外部计数器引用（_tail 或前驱的 next，以及之后的 _head），两者都释放且内部计数归零才删除节点。
+// 生产者先 CAS 占据尾部虚拟节点的 data，再链接新的虚拟节点；CAS 失败的生产者会帮忙链接 next 并推进 _tail，
+// 因此即使占据 data 的线程被挂起，其他生产者也不会阻塞
 template <typename T>
 class LockFreeQueue2
 {
 private:
     struct Node;
+    // external_count 用 intptr_t 而不是 int，保证结构体没有填充字节，双字 CAS 按位比较才可靠
     struct CountedNodePtr
     {
+        std::intptr_t external_count;
         Node* ptr;
-        int external_count;
     };
 
     struct NodeCounter
     {
         unsigned internal_count:30;
-        unsigned external_count:2;
+        unsigned external_counters:2;
     };
 
     struct Node
     {
         std::atomic<T*> data;
         std::atomic<NodeCounter> count;
-        std::atomic<CountedNodePtr> next;
+        DoubleWordAtomic<CountedNodePtr> next;
 
-        Node()
+        Node(): data(nullptr)
         {
             NodeCounter new_count;
             new_count.internal_count = 0;
-            new_count.external_count = 2;
+            new_count.external_counters = 2;
             count.store(new_count);
 
-            next.ptr = nullptr;
-            next.external_count = 0;
+            next.store(CountedNodePtr{0, nullptr});
         }
 
         void release_ref()
@@ -195,23 +479,85 @@ private:
                 new_counter = old_counter;
                 --new_counter.internal_count;
             }while(!count.compare_exchange_strong(
-                old_counter, new_counter),
-                std::memory_order_release, std::memory_order_release
-                );
+                old_counter, new_counter,
+                std::memory_order_acq_rel, std::memory_order_relaxed));
 
-            if(!new_counter.internal_count && !new_counter.external_count) delete this;
+            if(!new_counter.internal_count && !new_counter.external_counters) delete this;
         }
     };
 
 public:
-    LockFreeQueue2(): _head(CountedNodePtr()), _tail(_head){}
+    LockFreeQueue2()
+    {
+        CountedNodePtr dummy{1, new Node};
+        _head.store(dummy);
+        _tail.store(dummy);
+    }
+
+    // 析构时不能有其他线程访问队列
+    ~LockFreeQueue2()
+    {
+        Node* node = _head.load().ptr;
+        while(node)
+        {
+            Node* next = node->next.load().ptr;
+            delete node->data.load(std::memory_order_relaxed);
+            delete node;
+            node = next;
+        }
+    }
+
+    LockFreeQueue2(const LockFreeQueue2&) = delete;
+    LockFreeQueue2& operator=(const LockFreeQueue2&) = delete;
+
+    // 队列用到的原子对象是否都不需要加锁，x86-64 上需要 -mcx16
+    [[nodiscard]] bool is_lock_free() const
+    {
+        return _head.is_lock_free() && _tail.is_lock_free()
+            && std::atomic<NodeCounter>{}.is_lock_free() && std::atomic<T*>{}.is_lock_free();
+    }
 
     void push(const T& t)
     {
-        auto new_data = std::make_unique<T>(t);
-        CountedNodePtr new_next;
-        new_next.ptr = new Node;
-        new_next.external_count = 1;
+        push_data(std::make_unique<T>(t));
+    }
+
+    void push(T&& t)
+    {
+        push_data(std::make_unique<T>(std::move(t)));
+    }
+
+    // 队列为空时返回空指针
+    std::unique_ptr<T> pop()
+    {
+        CountedNodePtr old_head = _head.load(std::memory_order_relaxed);
+        while(true)
+        {
+            increase_external_count(_head, old_head);
+            Node* ptr = old_head.ptr;
+            if(ptr == _tail.load().ptr)
+            {
+                ptr->release_ref();
+                return std::unique_ptr<T>();
+            }
+            // 看到 _head != _tail 说明 ptr 的 next 已经链接好
+            CountedNodePtr next = ptr->next.load();
+            if(_head.compare_exchange_strong(old_head, next))
+            {
+                // 不能把 data 清回 nullptr：还握着旧 _tail 计数的生产者会对同一个节点做 data CAS，
+                // 清空后它会把元素写进已经出队的节点里，元素就丢了。节点不拥有 data，删除节点不会释放它
+                T* res = ptr->data.load();
+                free_external_counter(old_head);
+                return std::unique_ptr<T>(res);
+            }
+            ptr->release_ref();
+        }
+    }
+
+private:
+    void push_data(std::unique_ptr<T> new_data)
+    {
+        CountedNodePtr new_next{1, new Node};
         CountedNodePtr old_tail = _tail.load();
 
         while (true)
@@ -221,7 +567,8 @@ public:
 
             if(old_tail.ptr->data.compare_exchange_strong(old_data, new_data.get()))
             {
-                CountedNodePtr old_next = {0};
+                // 占到了尾部节点；如果其他生产者已经帮忙链接了 next，就用它的节点
+                CountedNodePtr old_next{0, nullptr};
                 if(!old_tail.ptr->next.compare_exchange_strong(old_next, new_next))
                 {
                     delete new_next.ptr;
@@ -234,82 +581,165 @@ public:
             }
             else
             {
-                CountedNodePtr old_next = {0};
-                if(old_tail.ptr->next.compare_exchange_strong(  // 11
-           old_next,new_next))
+                // 尾部节点已被占据，帮忙链接 next 并推进 _tail，然后重试
+                CountedNodePtr old_next{0, nullptr};
+                if(old_tail.ptr->next.compare_exchange_strong(old_next, new_next))
                 {
-                    old_next=new_next;  // 12
-                    new_next.ptr=new Node;  // 13
+                    old_next = new_next;
+                    new_next.ptr = new Node;
                 }
-                set_new_tail(old_tail, old_next);  // 14
-            }
-        }
-    }
-
-    std::unique_ptr<T> pop()
-    {
-        CountedNodePtr old_head = _head.load(std::memory_order_relaxed);
-        while(true)
-        {
-            increase_external_count(_head, old_head);
-            Node* ptr = old_head.ptr;
-            if(ptr == _tail.load().ptr)
-            {
-                ptr->release_ref();
-                return std::unique_ptr<T>();
-            }
-            CountedNodePtr next = ptr->next.load();
-            if(_head.compare_exchange_strong(old_head, ptr->next))
-            {
-                T* res = ptr->data.exchange(nullptr);
-                free_external_counter(old_head);
-                return std::unique_ptr<T>(*res);
+                set_new_tail(old_tail, old_next);
             }
-            ptr->release_ref();
         }
     }
 
-
-private:
-    std::atomic<CountedNodePtr> _head;
-    std::atomic<CountedNodePtr> _tail;
-
-    static void increase_external_count(std::atomic<CountedNodePtr>& counter,  CountedNodePtr& old_counter)
+    static void increase_external_count(DoubleWordAtomic<CountedNodePtr>& counter, CountedNodePtr& old_counter)
     {
         CountedNodePtr new_counter;
         do
         {
             new_counter = old_counter;
             ++new_counter.external_count;
-        }while(!counter.compare_exchange_strong(old_counter, new_counter), std::memory_order_acquire, std::memory_order_relaxed);
+        }while(!counter.compare_exchange_strong(
+            old_counter, new_counter,
+            std::memory_order_acquire, std::memory_order_relaxed));
 
         old_counter.external_count = new_counter.external_count;
     }
+
+    // 节点从 _head 或 _tail 上摘下时，把这个外部计数器累计的引用转移到内部计数。
+    // 计数的修改必须是 acq_rel：最后删除节点的线程要看到其他线程释放引用之前对节点的所有访问
     static void free_external_counter(CountedNodePtr& old_node_ptr)
     {
         Node* ptr = old_node_ptr.ptr;
-        int count_increase = old_node_ptr.external_count - 2;
+        int count_increase = static_cast<int>(old_node_ptr.external_count - 2);
         NodeCounter old_counter = ptr->count.load(std::memory_order_relaxed);
         NodeCounter new_counter;
         do
         {
             new_counter = old_counter;
-            --new_counter.external_count;
+            --new_counter.external_counters;
+            new_counter.internal_count += count_increase;
         }while(
             !ptr->count.compare_exchange_strong(
                 old_counter, new_counter,
-                std::memory_order_acquire, std::memory_order_relaxed)
+                std::memory_order_acq_rel, std::memory_order_relaxed)
                 );
-        if(!new_counter.internal_count && !new_counter.external_count) delete ptr;
+        if(!new_counter.internal_count && !new_counter.external_counters) delete ptr;
     }
 
-    void set_new_tail(CountedNodePtr &old_tail, CountedNodePtr &new_tail)
+    void set_new_tail(CountedNodePtr &old_tail, const CountedNodePtr &new_tail)
     {
         Node* current_tail_ptr = old_tail.ptr;
-        while(!_tail.compare_exchange_weak(old_tail, new_tail) && old_tail.ptr==current_tail_ptr){}
+        while(!_tail.compare_exchange_weak(old_tail, new_tail) && old_tail.ptr == current_tail_ptr){}
         if(old_tail.ptr == current_tail_ptr) free_external_counter(old_tail);
         else current_tail_ptr->release_ref();
     }
+
+private:
+    DoubleWordAtomic<CountedNodePtr> _head;
+    DoubleWordAtomic<CountedNodePtr> _tail;
+};
+
+// 有界无锁队列，多生产者、多消费者，容量固定为 2 的幂的数组，入队出队不分配内存
+// 每个槽位带一个序号：序号等于位置 pos 表示空槽等待第 pos 次入队，等于 pos + 1 表示已写入等待出队，
+// 出队后置为 pos + capacity 交给下一圈的生产者。生产者和消费者各自只对自己的计数器做一次 CAS 占位，
+// 之后只与同一个槽位的对端通过序号交接，_head 与 _tail 放在不同的缓存行上
+template <typename T>
+class LockFreeQueue3
+{
+private:
+    static constexpr std::size_t CACHE_LINE = 64;
+
+    struct Slot
+    {
+        std::atomic<std::size_t> sequence;
+        alignas(T) unsigned char storage[sizeof(T)];
+
+        T* element() {return std::launder(reinterpret_cast<T*>(storage));}
+    };
+
+public:
+    // 容量向上取整到 2 的幂
+    explicit LockFreeQueue3(std::size_t capacity = 1024)
+    {
+        std::size_t size = 2;
+        while(size < capacity) size <<= 1;
+        _mask = size - 1;
+        _slots = std::make_unique<Slot[]>(size);
+        for(std::size_t i = 0; i < size; ++i) _slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    // 析构时不能有其他线程访问队列
+    ~LockFreeQueue3()
+    {
+        std::size_t tail = _tail.load(std::memory_order_relaxed);
+        for(std::size_t pos = _head.load(std::memory_order_relaxed); pos != tail; ++pos)
+            _slots[pos & _mask].element()->~T();
+    }
+
+    LockFreeQueue3(const LockFreeQueue3&) = delete;
+    LockFreeQueue3& operator=(const LockFreeQueue3&) = delete;
+
+    [[nodiscard]] std::size_t capacity() const {return _mask + 1;}
+
+    // 队列满时返回 false
+    bool push(const T& t) {return emplace(t);}
+    bool push(T&& t) {return emplace(std::move(t));}
+
+    template <typename... Args>
+    bool emplace(Args&&... args)
+    {
+        std::size_t pos = _tail.load(std::memory_order_relaxed);
+        Slot* slot;
+        while(true)
+        {
+            slot = &_slots[pos & _mask];
+            std::size_t seq = slot->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+            if(diff == 0)
+            {
+                if(_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            }
+            else if(diff < 0) return false;  // 槽位还留着上一圈的元素，队列已满
+            else pos = _tail.load(std::memory_order_relaxed);  // 其他生产者已经占了这个位置
+        }
+
+        new (slot->storage) T(std::forward<Args>(args)...);
+        slot->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 队列为空时返回 false
+    bool pop(T& t)
+    {
+        std::size_t pos = _head.load(std::memory_order_relaxed);
+        Slot* slot;
+        while(true)
+        {
+            slot = &_slots[pos & _mask];
+            std::size_t seq = slot->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos + 1);
+            if(diff == 0)
+            {
+                if(_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            }
+            else if(diff < 0) return false;  // 这个位置还没有写入，队列为空
+            else pos = _head.load(std::memory_order_relaxed);
+        }
+
+        T* element = slot->element();
+        t = std::move(*element);
+        element->~T();
+        slot->sequence.store(pos + _mask + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    std::unique_ptr<Slot[]> _slots;
+    std::size_t _mask;
+    alignas(CACHE_LINE) std::atomic<std::size_t> _head{0};
+    alignas(CACHE_LINE) std::atomic<std::size_t> _tail{0};
 };
 
 #endif //QUEUE_H
@@ -0,0 +1,401 @@
+#ifndef SHM_QUEUE_H
+#define SHM_QUEUE_H
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <new>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "SpscQueueUtils.h"
+
+namespace sq{
+
+    // 放在共享内存中的跨进程 SPSC 队列：块结构和 front/tail 协议与 ReaderWriterQueue 相同，
+    // 但头部记录的 frontBlock/tailBlock 是相对映射起点的偏移量，块按下标顺序成环、元素区按块下标定位，
+    // 共享内存里不存指针，两个进程把同一段内存映射到不同地址也能共用。
+    // 容量在创建时固定，块在创建时一次性链成环，入队时不会分配（相当于 ReaderWriterQueue 的 try_enqueue）。
+    // 元素按字节放在共享内存里，所以 T 必须可平凡复制。
+    // 对端进程可能出错甚至恶意篡改共享内存，本进程不信任其中的任何偏移：块数和块大小在打开时校验一次后保存在本地，
+    // 块地址、元素区地址和下标掩码都由本地几何计算；frontBlock/tailBlock 偏移每次读取都做范围检查，
+    // front/tail 下标总是先掩码再使用，换块时对端写入的块状态不符合协议也视为损坏。
+    // 检查失败时操作抛出 std::system_error(EBADMSG)，越界的读写不会发生
+    template<typename T, size_t MAX_BLOCK_SIZE = 512, typename Ordering = DefaultOrdering>
+    class SharedMemoryQueue
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "SharedMemoryQueue 只能存放可平凡复制的类型");
+        static_assert(alignof(T) <= CACHE_LINE_SIZE, "元素的对齐要求不能超过缓存行");
+        static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "共享内存中的原子量必须是无锁的");
+
+        public:
+            // 在 memfd 上创建队列，fd 可以通过 fork 继承或 SCM_RIGHTS 传给另一个进程，再用 attach 打开
+            static SharedMemoryQueue create(const char* name, size_t capacity)
+            {
+                int fd = memfd_create(name, MFD_CLOEXEC);
+                if (fd < 0) throw std::system_error(errno, std::generic_category(), "memfd_create");
+                return SharedMemoryQueue(fd, capacity);
+            }
+
+            // 以 shm_open 的名字（如 "/sq-orders"）创建队列，名字已存在时失败；用完后由某一方调用 unlink
+            static SharedMemoryQueue create_named(const char* name, size_t capacity)
+            {
+                int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+                if (fd < 0) throw std::system_error(errno, std::generic_category(), "shm_open");
+                return SharedMemoryQueue(fd, capacity);
+            }
+
+            // 打开另一个进程已经创建完成的队列；fd 由本对象接管
+            static SharedMemoryQueue attach(int fd) {return SharedMemoryQueue(fd);}
+
+            static SharedMemoryQueue open_named(const char* name)
+            {
+                int fd = shm_open(name, O_RDWR, 0);
+                if (fd < 0) throw std::system_error(errno, std::generic_category(), "shm_open");
+                return SharedMemoryQueue(fd);
+            }
+
+            static void unlink(const char* name) {shm_unlink(name);}
+
+            SharedMemoryQueue(SharedMemoryQueue&& other) noexcept
+            : base(std::exchange(other.base, nullptr)), regionSize(other.regionSize), fd(std::exchange(other.fd, -1))
+            , header(other.header), cachedFrontBlock(other.cachedFrontBlock)
+            , blockCount(other.blockCount), sizeMask(other.sizeMask), blocksOffset(other.blocksOffset), dataOffset(other.dataOffset)
+            {}
+
+            SharedMemoryQueue(const SharedMemoryQueue&) = delete;
+            SharedMemoryQueue& operator=(const SharedMemoryQueue&) = delete;
+            SharedMemoryQueue& operator=(SharedMemoryQueue&&) = delete;
+
+            // 只解除本进程的映射，队列中的元素留在共享内存中
+            ~SharedMemoryQueue()
+            {
+                if (base != nullptr) munmap(base, regionSize);
+                if (fd >= 0) close(fd);
+            }
+
+            [[nodiscard]] int get_fd() const {return fd;}
+
+            // 以下入队接口只能由生产者进程中的一个线程调用，队列满时返回 false
+            template<typename... Args>
+            bool try_emplace(Args&&... args);
+
+            bool try_enqueue(const T& element) {return try_emplace(element);}
+
+            // 以下出队接口只能由消费者进程中的一个线程调用
+            bool try_dequeue(T& result) {return inner_dequeue([&result](T& element) {result = element;});}
+
+            T* peek();
+
+            bool pop() {return inner_dequeue([](T&) {});}
+
+            [[nodiscard]] size_t size_approx() const;
+
+            [[nodiscard]] size_t max_capacity() const {return blockCount * sizeMask;}
+
+        private:
+            static constexpr std::uint64_t MAGIC = 0x5351'5348'4d51'0002ULL;  // "SQSHMQ" + 版本
+
+            // front/local_tail、tail/local_front 各占一个缓存行，与 Block 相同；
+            // 下一个块、元素区和下标掩码都由本地几何计算，不在块里存放
+            struct ShmBlock
+            {
+                alignas(CACHE_LINE_SIZE) std::atomic<std::uint64_t> front;
+                std::uint64_t local_tail;  // 消费者进程的 tail 副本
+
+                alignas(CACHE_LINE_SIZE) std::atomic<std::uint64_t> tail;
+                std::uint64_t local_front;  // 生产者进程的 front 副本
+            };
+
+            struct Header
+            {
+                std::atomic<std::uint64_t> magic;  // 创建方初始化完成后最后写入
+                std::uint64_t elementSize;
+                std::uint64_t blockCount;
+                std::uint64_t blockSize;
+                std::uint64_t regionSize;
+
+                alignas(CACHE_LINE_SIZE) std::atomic<std::uint64_t> frontBlock;  // 消费者拥有
+                alignas(CACHE_LINE_SIZE) std::atomic<std::uint64_t> tailBlock;  // 生产者拥有
+            };
+
+            static constexpr size_t round_up(size_t size) {return (size + CACHE_LINE_SIZE - 1) & ~(CACHE_LINE_SIZE - 1);}
+
+            static constexpr size_t ceilToPow2(size_t x)
+            {
+                size_t result = 1;
+                while (result < x) result <<= 1;
+                return result;
+            }
+
+            // 创建：块数与块大小的计算和 ReaderWriterQueue 的构造函数一致
+            SharedMemoryQueue(int _fd, size_t capacity) : fd(_fd)
+            {
+                size_t blockSize = ceilToPow2(capacity + 1);
+                size_t count = 1;
+                if (blockSize > MAX_BLOCK_SIZE * 2) {
+                    count = (capacity + MAX_BLOCK_SIZE * 2 - 3) / (MAX_BLOCK_SIZE - 1);
+                    blockSize = MAX_BLOCK_SIZE;
+                }
+                if (!set_geometry(count, blockSize)) fail("SharedMemoryQueue: capacity too large", EINVAL);
+
+                if (ftruncate(fd, static_cast<off_t>(regionSize)) != 0) fail("ftruncate");
+                map();
+
+                header = new (base) Header();
+                header->elementSize = sizeof(T);
+                header->blockCount = blockCount;
+                header->blockSize = blockSize;
+                header->regionSize = regionSize;
+
+                for (size_t i = 0; i != blockCount; ++i) new (block_at(i)) ShmBlock();
+                header->frontBlock.store(blocksOffset, std::memory_order_relaxed);
+                header->tailBlock.store(blocksOffset, std::memory_order_relaxed);
+                cachedFrontBlock = block_at(0);
+                header->magic.store(MAGIC, std::memory_order_release);
+            }
+
+            // 打开：先按文件大小映射，再校验头部
+            explicit SharedMemoryQueue(int _fd) : fd(_fd)
+            {
+                struct stat st{};
+                if (fstat(fd, &st) != 0) fail("fstat");
+                regionSize = static_cast<size_t>(st.st_size);
+                if (regionSize < sizeof(Header)) fail("SharedMemoryQueue: region is not initialised", EINVAL);
+                map();
+
+                header = reinterpret_cast<Header*>(base);
+                if (header->magic.load(std::memory_order_acquire) != MAGIC || header->elementSize != sizeof(T) ||
+                    header->regionSize != regionSize)
+                    fail("SharedMemoryQueue: region does not hold a queue of this element type", EINVAL);
+
+                // 几何只在这里读取一次：必须能由同样的公式恰好排满整个映射区
+                std::uint64_t count = header->blockCount;
+                std::uint64_t blockSize = header->blockSize;
+                std::size_t mappedSize = regionSize;
+                if (count == 0 || blockSize < 2 || (blockSize & (blockSize - 1)) != 0 ||
+                    !set_geometry(count, blockSize) || regionSize != mappedSize)
+                    fail("SharedMemoryQueue: region has an invalid block layout", EINVAL);
+
+                std::uint64_t frontOffset = header->frontBlock.load(Ordering::load_order);
+                if (!valid_block_offset(frontOffset)) fail("SharedMemoryQueue: region has an invalid front block", EINVAL);
+                cachedFrontBlock = block_at(block_index(frontOffset));
+            }
+
+            // 计算各区域的偏移并写入 regionSize，乘法溢出时返回 false
+            bool set_geometry(std::uint64_t count, std::uint64_t blockSize)
+            {
+                std::uint64_t headerBytes = round_up(sizeof(Header));
+                std::uint64_t blockBytes, elementCount, dataBytes, dataStart, total;
+                if (__builtin_mul_overflow(count, sizeof(ShmBlock), &blockBytes) ||
+                    __builtin_mul_overflow(count, blockSize, &elementCount) ||
+                    __builtin_mul_overflow(elementCount, sizeof(T), &dataBytes) ||
+                    __builtin_add_overflow(headerBytes, blockBytes, &dataStart) ||
+                    dataBytes > SIZE_MAX - CACHE_LINE_SIZE ||
+                    __builtin_add_overflow(dataStart, round_up(dataBytes), &total))
+                    return false;
+
+                blockCount = count;
+                sizeMask = blockSize - 1;
+                blocksOffset = headerBytes;
+                dataOffset = dataStart;
+                regionSize = total;
+                return true;
+            }
+
+            void map()
+            {
+                void* region = mmap(nullptr, regionSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                if (region == MAP_FAILED) fail("mmap");
+                base = static_cast<char*>(region);
+            }
+
+            // 构造失败时析构函数不会运行，先释放已经拿到的资源再抛出
+            [[noreturn]] void fail(const char* what, int error = errno)
+            {
+                if (base != nullptr) munmap(base, regionSize);
+                close(fd);
+                throw std::system_error(error, std::generic_category(), what);
+            }
+
+            ShmBlock* block_at(size_t index) const {return reinterpret_cast<ShmBlock*>(base + blocksOffset) + index;}
+            size_t index_of(const ShmBlock* block) const {return block - block_at(0);}
+            std::uint64_t offset_of(const ShmBlock* block) const {return blocksOffset + index_of(block) * sizeof(ShmBlock);}
+            ShmBlock* next_block(const ShmBlock* block) const {return block_at((index_of(block) + 1) % blockCount);}
+
+            // 元素区由本地几何定位，下标来自共享内存，先掩码保证落在块内
+            T* element_at(const ShmBlock* block, std::uint64_t idx) const
+            {
+                return reinterpret_cast<T*>(base + dataOffset) + index_of(block) * (sizeMask + 1) + (idx & sizeMask);
+            }
+
+            bool valid_block_offset(std::uint64_t offset) const
+            {
+                std::uint64_t relative = offset - blocksOffset;
+                return offset >= blocksOffset && relative % sizeof(ShmBlock) == 0 && relative / sizeof(ShmBlock) < blockCount;
+            }
+
+            size_t block_index(std::uint64_t offset) const {return (offset - blocksOffset) / sizeof(ShmBlock);}
+
+            [[noreturn]] static void corrupted(const char* what)
+            {
+                throw std::system_error(EBADMSG, std::generic_category(), what);
+            }
+
+            // 从共享的 frontBlock/tailBlock 读出的偏移，不指向某个块的起点就拒绝继续
+            ShmBlock* checked_block(std::uint64_t offset) const
+            {
+                if (!valid_block_offset(offset)) corrupted("SharedMemoryQueue: corrupted block offset");
+                return block_at(block_index(offset));
+            }
+
+            template<typename F>
+            bool inner_dequeue(F&& consume);
+
+            char* base{nullptr};
+            size_t regionSize{0};
+            int fd{-1};
+            Header* header{nullptr};
+            ShmBlock* cachedFrontBlock{nullptr};  // 生产者本地缓存的 frontBlock，只在尾部块满时刷新
+
+            // 本进程保存的几何，创建或打开之后不再从共享内存读取
+            size_t blockCount{0};
+            std::uint64_t sizeMask{0};
+            size_t blocksOffset{0};
+            size_t dataOffset{0};
+    };
+
+    template<typename T, size_t MAX_BLOCK_SIZE, typename Ordering>
+    template<typename... Args>
+    bool SharedMemoryQueue<T, MAX_BLOCK_SIZE, Ordering>::try_emplace(Args&&... args)
+    {
+        ShmBlock* tailBlock_ = checked_block(header->tailBlock.load(Ordering::load_order));
+        std::uint64_t blockTail = tailBlock_->tail.load(Ordering::load_order);
+        std::uint64_t nextBlockTail = (blockTail + 1) & sizeMask;
+
+        if (nextBlockTail != tailBlock_->local_front ||
+            nextBlockTail != (tailBlock_->local_front = tailBlock_->front.load(Ordering::load_order)))
+        {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            new (element_at(tailBlock_, blockTail)) T(std::forward<Args>(args)...);
+
+            std::atomic_thread_fence(std::memory_order_release);
+            tailBlock_->tail.store(nextBlockTail, Ordering::store_order);
+            return true;
+        }
+
+        // 尾部块已满：下一个块不是前端块时必然已被取空，可以直接前移
+        std::atomic_thread_fence(std::memory_order_acquire);
+        ShmBlock* nextBlock = next_block(tailBlock_);
+        if (nextBlock == cachedFrontBlock) {
+            cachedFrontBlock = checked_block(header->frontBlock.load(Ordering::load_order));
+            if (nextBlock == cachedFrontBlock) return false;
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        nextBlock->local_front = nextBlock->front.load(Ordering::load_order);
+        blockTail = nextBlock->tail.load(Ordering::load_order);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        // 前端块之外的块必然已被取空
+        if (blockTail != nextBlock->local_front) corrupted("SharedMemoryQueue: corrupted block state");
+
+        new (element_at(nextBlock, blockTail)) T(std::forward<Args>(args)...);
+        nextBlock->tail.store((blockTail + 1) & sizeMask, Ordering::store_order);
+
+        std::atomic_thread_fence(std::memory_order_release);
+        header->tailBlock.store(offset_of(nextBlock), Ordering::store_order);
+        return true;
+    }
+
+    template<typename T, size_t MAX_BLOCK_SIZE, typename Ordering>
+    template<typename F>
+    bool SharedMemoryQueue<T, MAX_BLOCK_SIZE, Ordering>::inner_dequeue(F&& consume)
+    {
+        ShmBlock* frontBlock_ = checked_block(header->frontBlock.load(Ordering::load_order));
+        std::uint64_t blockFront = frontBlock_->front.load(Ordering::load_order);
+
+        if (blockFront != frontBlock_->local_tail ||
+            blockFront != (frontBlock_->local_tail = frontBlock_->tail.load(Ordering::load_order)))
+        {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            consume(*element_at(frontBlock_, blockFront));
+
+            std::atomic_thread_fence(std::memory_order_release);
+            frontBlock_->front.store((blockFront + 1) & sizeMask, Ordering::store_order);
+            return true;
+        }
+
+        if (offset_of(frontBlock_) == header->tailBlock.load(Ordering::load_order)) return false;
+
+        // 生产者已离开前端块：重读它最终的 tail，仍为空则元素在下一个块
+        std::atomic_thread_fence(std::memory_order_acquire);
+        frontBlock_->local_tail = frontBlock_->tail.load(Ordering::load_order);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (blockFront == frontBlock_->local_tail) {
+            frontBlock_ = next_block(frontBlock_);
+            blockFront = frontBlock_->front.load(Ordering::load_order);
+            frontBlock_->local_tail = frontBlock_->tail.load(Ordering::load_order);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            // 生产者只有在下一个块写入元素之后才会离开前端块
+            if (blockFront == frontBlock_->local_tail) corrupted("SharedMemoryQueue: corrupted block state");
+
+            std::atomic_thread_fence(std::memory_order_release);
+            header->frontBlock.store(offset_of(frontBlock_), Ordering::store_order);
+        }
+
+        consume(*element_at(frontBlock_, blockFront));
+        std::atomic_thread_fence(std::memory_order_release);
+        frontBlock_->front.store((blockFront + 1) & sizeMask, Ordering::store_order);
+        return true;
+    }
+
+    template<typename T, size_t MAX_BLOCK_SIZE, typename Ordering>
+    T* SharedMemoryQueue<T, MAX_BLOCK_SIZE, Ordering>::peek()
+    {
+        ShmBlock* frontBlock_ = checked_block(header->frontBlock.load(Ordering::load_order));
+        std::uint64_t blockFront = frontBlock_->front.load(Ordering::load_order);
+
+        if (blockFront != frontBlock_->local_tail ||
+            blockFront != (frontBlock_->local_tail = frontBlock_->tail.load(Ordering::load_order)))
+        {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return element_at(frontBlock_, blockFront);
+        }
+
+        if (offset_of(frontBlock_) == header->tailBlock.load(Ordering::load_order)) return nullptr;
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        frontBlock_->local_tail = frontBlock_->tail.load(Ordering::load_order);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (blockFront != frontBlock_->local_tail) return element_at(frontBlock_, blockFront);
+
+        ShmBlock* nextBlock = next_block(frontBlock_);
+        blockFront = nextBlock->front.load(Ordering::load_order);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return element_at(nextBlock, blockFront);
+    }
+
+    template<typename T, size_t MAX_BLOCK_SIZE, typename Ordering>
+    size_t SharedMemoryQueue<T, MAX_BLOCK_SIZE, Ordering>::size_approx() const
+    {
+        size_t result = 0;
+        ShmBlock* block = checked_block(header->frontBlock.load(Ordering::load_order));
+        ShmBlock* tailBlock_ = checked_block(header->tailBlock.load(Ordering::load_order));
+        while (true) {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            std::uint64_t blockFront = block->front.load(Ordering::load_order);
+            std::uint64_t blockTail = block->tail.load(Ordering::load_order);
+            result += (blockTail - blockFront) & sizeMask;
+            if (block == tailBlock_) break;
+            block = next_block(block);
+        }
+        return result;
+    }
+
+}
+
+#endif
@@ -9,16 +9,31 @@
 #include <new>
 #include <memory>
 #include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
 #include "SpscQueueUtils.h"
 
+// 编译器支持 C++20 协程时才提供 AwaitableReaderWriterQueue
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L && __has_include(<coroutine>)
+#include <coroutine>
+#define SQ_HAS_COROUTINES 1
+#else
+#define SQ_HAS_COROUTINES 0
+#endif
+
 namespace sq{
 
-template<typename T, size_t MAX_BLOCK_SIZE = 512>
+template<typename T, size_t MAX_BLOCK_SIZE = 512, typename Ordering = DefaultOrdering, typename Allocator = MallocBlockAllocator>
 class alignas(CACHE_LINE_SIZE) ReaderWriterQueue
     {
         public:
-            using Block = sq::Block<T>;
-            explicit ReaderWriterQueue(size_t size = 15);
+            using Block = sq::Block<T, Ordering>;
+            enum AllocationMode {CanAlloc, CannotAlloc};
+
+            explicit ReaderWriterQueue(size_t size = 15, const Allocator& _allocator = Allocator());
 
             ReaderWriterQueue(const ReaderWriterQueue& ) = delete;
             ReaderWriterQueue(ReaderWriterQueue&& other) noexcept;
@@ -28,14 +43,126 @@ class alignas(CACHE_LINE_SIZE) ReaderWriterQueue
             ~ReaderWriterQueue();
 
             template<typename U>
-            bool try_dequeue(U& result);
+            bool try_dequeue(U& result) {return inner_dequeue([&result](T& element) {result = std::move(element);});}
+
+            // 按 strategy（BusySpinWait、SpinYieldWait、BackoffWait、SpinParkWait 等）等待，直到取出一个元素。
+            // 使用 SpinParkWait 时生产者每次入队后要调用同一个 strategy 的 notify
+            template<typename U, typename Strategy>
+            void dequeue_wait(U& result, Strategy&& strategy) {strategy.wait([this, &result]() {return try_dequeue(result);});}
+
+            // 返回队首元素的指针（不移出），队列为空返回 nullptr；只能由消费者调用
+            T* peek() const;
+
+            // 直接析构并丢弃队首元素，与 peek 配合实现原地读取
+            bool pop() {return inner_dequeue([](T&) {});}
+
+            // 用 args 在块内原地构造元素；CannotAlloc 时所有已有块都满则直接返回 false，绝不调用 make_block
+            template<AllocationMode canAlloc = CanAlloc, typename... Args>
+            bool inner_enqueue(Args&&... args);
+
+            template<typename... Args>
+            bool try_emplace(Args&&... args) {return inner_enqueue<CannotAlloc>(std::forward<Args>(args)...);}
+
+            template<typename... Args>
+            bool emplace(Args&&... args) {return inner_enqueue<CanAlloc>(std::forward<Args>(args)...);}
+
+            // 只使用已分配的块，队列满时返回 false，保证不会分配内存
+            template<typename U>
+            bool try_enqueue(U&& element) {return inner_enqueue<CannotAlloc>(std::forward<U>(element));}
 
+            // 空间不足时分配新块，只有分配失败才返回 false
             template<typename U>
-            bool inner_enqueue(U&& element);
+            bool enqueue(U&& element) {return inner_enqueue<CanAlloc>(std::forward<U>(element));}
+
+            // 批量入队：先备足空间再逐块构造，每个块只做一次 tail 发布；空间不足且无法（或不允许）分配时不入队任何元素
+            template<typename It>
+            bool enqueue_bulk(It first, size_t count) {return inner_enqueue_bulk<CanAlloc>(first, count);}
+
+            template<typename It>
+            bool try_enqueue_bulk(It first, size_t count) {return inner_enqueue_bulk<CannotAlloc>(first, count);}
+
+            // 预留下一个槽位，返回块内尚未构造的存储；调用者在其上 placement new 出 T 后调用 commit 发布。
+            // 预留与提交之间不能有其他入队操作。try_reserve 不分配，队列满时返回 nullptr
+            T* try_reserve() {return inner_reserve<CannotAlloc>();}
+            T* reserve() {return inner_reserve<CanAlloc>();}
+            void commit();
+
+            // 批量出队：最多取出 max 个元素写入 out，每个块只做一次 front 发布，返回实际出队数量。
+            // 移动赋值抛出异常时，之前取出的元素照常出队，抛出异常的元素留在队首
+            template<typename It>
+            size_t try_dequeue_bulk(It out, size_t max);
+
+            // 排空：只读一次生产者的 tailBlock 和它的 tail，对快照内（最多 max 个）元素原地调用 f(T&) 后析构，
+            // 跨块时不重复检查，每个块只在离开时发布一次 front，frontBlock 在最后发布一次。返回处理的元素数。
+            // f 抛出异常时，之前处理过的元素照常出队，抛出异常的元素留在队首，异常继续向外传播
+            template<typename F>
+            size_t consume_up_to(size_t max, F&& f);
 
+            template<typename F>
+            size_t consume_all(F&& f) {return consume_up_to(SIZE_MAX, std::forward<F>(f));}
+
+            // 队列为空时，不分配新块所能容纳的元素总数，任意线程都可以调用
+            [[nodiscard]] size_t max_capacity() const {return totalCapacity.load(std::memory_order_relaxed);}
+
+            // 当前元素数量的近似值，生产者与消费者线程都可以调用
+            [[nodiscard]] size_t size_approx() const;
+
+            // 由生产者调用：突发过后释放尾部块之后已被取空的块，直到总容量不超过 retained，
+            // 前端块到尾部块之间的块不会被释放。不能在 reserve 与 commit 之间调用。返回收缩后的容量
+            size_t shrink_to(size_t retained);
+
+            // 由生产者调用：保证之后至少 count 个元素可以不分配内存地入队（尾部块剩余槽位加上其后已取空的块，
+            // 不够时一次性链接新块），分配失败返回 false。配合 PrefaultAllocator 可以在启动时把缺页全部提前。
+            // 不能在 reserve 与 commit 之间调用
+            bool reserve_capacity(size_t count);
+
+            // 延迟发布（写合并）模式，只能由生产者调用：inner_enqueue 把元素写进尾部块，但攒够 batch 个才做一次
+            // store_tail，减少 tail 所在缓存行在两个核之间的来回传递。batch 为 1（默认）时每个元素立即发布。
+            // 未发布的元素对消费者不可见，批次结束时调用 flush；切换块、批量入队和 reserve 之前会自动发布
+            void set_publish_batch(size_t batch)
+            {
+                SQ_REENTRANT_GUARD(enqueuing);
+                assert(batch >= 1);
+                publish_pending(tailBlock.load(Ordering::load_order));
+                publishBatch = batch;
+            }
+
+            void flush()
+            {
+                SQ_REENTRANT_GUARD(enqueuing);
+                publish_pending(tailBlock.load(Ordering::load_order));
+            }
+
+#if SQ_ENABLE_STATS
+            // 任意线程都可以调用，见 QueueStats
+            [[nodiscard]] QueueStats stats() const
+            {
+                size_t consumer[CONSUMER_STAT_COUNT];
+                size_t producer[PRODUCER_STAT_COUNT];
+                consumerStats.snapshot(consumer);
+                producerStats.snapshot(producer);
+                return QueueStats{producer[ENQUEUED], consumer[DEQUEUED], producer[BLOCKS_ALLOCATED], producer[TAIL_BLOCK_FULL],
+                                  consumer[BLOCK_HOPS], producer[HIGH_WATER_MARK], totalCapacity.load(std::memory_order_relaxed)};
+            }
+#endif
 
 
         private:
+            template<AllocationMode canAlloc, typename It>
+            bool inner_enqueue_bulk(It first, size_t count);
+
+            template<AllocationMode canAlloc>
+            T* inner_reserve();
+
+            // 从尾部块开始统计空闲槽位（尾部块剩 available 个），不足 count 时在最后一个空闲块后面链接新块
+            template<AllocationMode canAlloc>
+            bool link_free_blocks(Block* tailBlock_, size_t available, size_t count);
+
+            // consume 在元素析构之前对其调用一次
+            template<typename F>
+            bool inner_dequeue(F&& consume);
+
+
             static constexpr size_t ceilToPow2(size_t x)
         {
                 --x;
@@ -50,19 +177,117 @@ class alignas(CACHE_LINE_SIZE) ReaderWriterQueue
                 return x;
         }
 
+            // 按增长策略分配一个尚未链接的新块，分配失败返回 nullptr
+            Block* make_growth_block()
+            {
+                auto newBlockSize = largestBlockSize >= MAX_BLOCK_SIZE ? largestBlockSize : largestBlockSize * 2;
+                Block* newBlock;
+                try
+                {
+                    newBlock = Block::make_block(newBlockSize, allocator);
+                }
+                catch (const std::bad_alloc& e)
+                {
+                    return nullptr;
+                }
+                largestBlockSize = newBlockSize;
+                SQ_STATS(producer_stat(BLOCKS_ALLOCATED));
+                totalCapacity.store(totalCapacity.load(std::memory_order_relaxed) + newBlock->get_size_mask(), std::memory_order_relaxed);
+                return newBlock;
+            }
+
+            // 生产者判断 block 之后的块是否已被取空。frontBlock 只会朝 tailBlock 前进，
+            // 过期的缓存只会让判断偏保守，所以只在缓存认为"没有空闲块"时才去读消费者的缓存行
+            bool next_block_free(Block* block)
+            {
+                Block* next = block->next_block();
+                if (next != cachedFrontBlock) return true;
+                cachedFrontBlock = frontBlock.load(Ordering::load_order);
+                return next != cachedFrontBlock;
+            }
+
+#if SQ_ENABLE_STATS
+            enum ProducerStat {ENQUEUED, BLOCKS_ALLOCATED, TAIL_BLOCK_FULL, HIGH_WATER_MARK, PRODUCER_STAT_COUNT};
+            enum ConsumerStat {DEQUEUED, BLOCK_HOPS, CONSUMER_STAT_COUNT};
+
+            void producer_stat(ProducerStat idx)
+            {
+                producerStats.begin_write();
+                producerStats.add(idx);
+                producerStats.end_write();
+            }
+
+            // 只有按缓存的出队数算出的上界超过历史最大值时才去读消费者的计数，
+            // 缓存值只会偏小，所以不会漏掉新的最大值
+            void record_enqueue(size_t count)
+            {
+                producerStats.begin_write();
+                size_t enqueued = producerStats.get(ENQUEUED) + count;
+                producerStats.set(ENQUEUED, enqueued);
+                if (enqueued - statsDequeued > producerStats.get(HIGH_WATER_MARK)) {
+                    statsDequeued = consumerStats.get(DEQUEUED);
+                    if (enqueued - statsDequeued > producerStats.get(HIGH_WATER_MARK))
+                        producerStats.set(HIGH_WATER_MARK, enqueued - statsDequeued);
+                }
+                producerStats.end_write();
+            }
+
+            void record_dequeue(size_t count, size_t hops)
+            {
+                consumerStats.begin_write();
+                consumerStats.add(DEQUEUED, count);
+                consumerStats.add(BLOCK_HOPS, hops);
+                consumerStats.end_write();
+            }
+#endif
+
+            // 把延迟的 tail 写回尾部块。消费者看到 tailBlock 前移后会把前端块的 tail 当作最终值，
+            // 所以移动 tailBlock 之前必须先调用
+            void publish_pending(Block* tailBlock_)
+            {
+                if (pendingCount == 0) return;
+                std::atomic_thread_fence(std::memory_order_release);
+                tailBlock_->store_tail(pendingTail);
+                pendingCount = 0;
+            }
+
         private:
-            std::atomic<Block*> frontBlock{};  // （原子）元素从此块中出列
-            std::atomic<Block*> tailBlock{};  //（原子）元素排队到该块中
-            size_t largestBlockSize;
+            // 消费者拥有的状态，独占一个缓存行
+            alignas(CACHE_LINE_SIZE) std::atomic<Block*> frontBlock{};  // （原子）元素从此块中出列
+#if SQ_DEBUG_CHECKS
+            mutable std::atomic<bool> dequeuing{false};
+#endif
+#if SQ_ENABLE_STATS
+            StatCounters<CONSUMER_STAT_COUNT> consumerStats;  // 只由消费者修改
+#endif
+
+            // 消费者在前端块取空时读取 tailBlock。它所在的缓存行只放换块、扩容时才会写的字段，
+            // 生产者每次入队都可能写的临时状态放在下一个缓存行，不会让消费者读的这一行失效
+            alignas(CACHE_LINE_SIZE) std::atomic<Block*> tailBlock{};  //（原子）元素排队到该块中
+            std::atomic<size_t> totalCapacity{0};  // 只由生产者修改
 
+            // 生产者私有的状态，消费者从不访问
+            alignas(CACHE_LINE_SIZE) Block* cachedFrontBlock{};  // 生产者本地缓存的 frontBlock，只在尾部块满时刷新
+            size_t largestBlockSize;
+            Block* reservedBlock{nullptr};  // reserve 选中的块，commit 时在此发布
+            size_t publishBatch{1};  // 攒够多少个元素才发布一次 tail
+            size_t pendingCount{0};  // 尾部块中已构造但尚未发布的元素数
+            size_t pendingTail{0};  // pendingCount 不为 0 时尾部块真正的 tail
+            Allocator allocator;  // 块只在生产者线程上分配和释放（以及队列析构时）
+#if SQ_DEBUG_CHECKS
             std::atomic<bool> enqueuing{false};
-            std::atomic<bool> dequeuing{false};
+#endif
+#if SQ_ENABLE_STATS
+            size_t statsDequeued{0};  // 生产者缓存的出队数，只用于更新 highWaterMark
+            StatCounters<PRODUCER_STAT_COUNT> producerStats;  // 只由生产者修改
+#endif
     };
 
 
 
-    template<typename T, size_t MAX_BLOCK_SIZE>
-    ReaderWriterQueue<T, MAX_BLOCK_SIZE>::ReaderWriterQueue(size_t size)
+    template<typename T, size_t MAX_BLOCK_SIZE, typename Ordering, typename Allocator>
+    ReaderWriterQueue<T, MAX_BLOCK_SIZE, Ordering, Allocator>::ReaderWriterQueue(size_t size, const Allocator& _allocator)
+    : allocator(_allocator)
     {   // 单向环形链表，头尾指向相同节点的空结点
         assert(MAX_BLOCK_SIZE == ceilToPow2(MAX_BLOCK_SIZE));
         assert(MAX_BLOCK_SIZE >= 2);
@@ -75,7 +300,7 @@ class alignas(CACHE_LINE_SIZE) ReaderWriterQueue
             largestBlockSize = MAX_BLOCK_SIZE;
             Block* lastBlock = nullptr;
             for (size_t i = 0; i != initialBlockCount; ++i) {
-                auto block = Block::make_block(largestBlockSize);
+                auto block = Block::make_block(largestBlockSize, allocator);
                 if (firstBlock == nullptr) {
                     firstBlock = block;
                 } else {
@@ -85,31 +310,50 @@ class alignas(CACHE_LINE_SIZE) ReaderWriterQueue
                 block->store_next(firstBlock);
             }
         } else {
-            firstBlock = Block::make_block(largestBlockSize);
+            firstBlock = Block::make_block(largestBlockSize, allocator);
             firstBlock->store_next(firstBlock);
         }
         frontBlock.store(firstBlock);
         tailBlock.store(firstBlock);
+        cachedFrontBlock = firstBlock;
+
+        size_t capacity = 0;
+        Block* block = firstBlock;
+        do {
+            capacity += block->get_size_mask();
+            SQ_STATS(producerStats.add(BLOCKS_ALLOCATED));
+            block = block->next_block();
+        } while (block != firstBlock);
+        totalCapacity.store(capacity);
 
         std::atomic_thread_fence(std::memory_order_seq_cst);
     }
 
-    template<typename T, size_t MAX_BLOCK_SIZE>
-    ReaderWriterQueue<T, MAX_BLOCK_SIZE>::ReaderWriterQueue(ReaderWriterQueue &&other) noexcept
+    template<typename T, size_t MAX_BLOCK_SIZE, typename Ordering, typename Allocator>
+    ReaderWriterQueue<T, MAX_BLOCK_SIZE, Ordering, Allocator>::ReaderWriterQueue(ReaderWriterQueue &&other) noexcept
     : frontBlock(other.frontBlock.load())
     , tailBlock(other.tailBlock.load())
+    , totalCapacity(other.totalCapacity.load())
+    , cachedFrontBlock(other.cachedFrontBlock)
     , largestBlockSize(other.largestBlockSize)
+    , publishBatch(other.publishBatch)
+    , pendingCount(other.pendingCount)
+    , pendingTail(other.pendingTail)
+    , allocator(other.allocator)
     {
         other.largestBlockSize = 32;
-        Block* b = Block::make_block(other.largestBlockSize);
+        Block* b = Block::make_block(other.largestBlockSize, other.allocator);
 
         b->store_next(b);
         other.frontBlock = b;
         other.tailBlock = b;
+        other.cachedFrontBlock = b;
+        other.totalCapacity = b->get_size_mask();
+        other.pendingCount = 0;
     }
 
-    template<typename T, size_t MAX_BLOCK_SIZE>
-    ReaderWriterQueue<T, MAX_BLOCK_SIZE>& ReaderWriterQueue<T, MAX_BLOCK_SIZE>::operator=(ReaderWriterQueue&& other) noexcept {  // 相当于交换彼此
+    template<typename T, size_t MAX_BLOCK_SIZE, typename Ordering, typename Allocator>
+    ReaderWriterQueue<T, MAX_BLOCK_SIZE, Ordering, Allocator>& ReaderWriterQueue<T, MAX_BLOCK_SIZE, Ordering, Allocator>::operator=(ReaderWriterQueue&& other) noexcept {  // 相当于交换彼此
         Block* b = frontBlock.load();
         frontBlock = other.frontBlock.load();
         other.frontBlock = b;
@@ -118,30 +362,40 @@ class alignas(CACHE_LINE_SIZE) ReaderWriterQueue
         tailBlock = other.tailBlock.load();
         other.tailBlock = b;
 
+        std::swap(cachedFrontBlock, other.cachedFrontBlock);
         std::swap(largestBlockSize, other.largestBlockSize);
+        std::swap(publishBatch, other.publishBatch);
+        std::swap(pendingCount, other.pendingCount);
+        std::swap(pendingTail, other.pendingTail);
+        std::swap(allocator, other.allocator);
+
+        size_t capacity = totalCapacity.load();
+        totalCapacity = other.totalCapacity.load();
+        other.totalCapacity = capacity;
         return *this;
     }
 
-    template<typename T, size_t MAX_BLOCK_SIZE>
-    ReaderWriterQueue<T, MAX_BLOCK_SIZE>::~ReaderWriterQueue()
-    { // 一个一个块进行析构
+    template<typename T, size_t MAX_BLOCK_SIZE, typename Ordering, typename Allocator>
+    ReaderWriterQueue<T, MAX_BLOCK_SIZE, Ordering, Allocator>::~ReaderWriterQueue()
+    { // 一个一个块进行析构，未发布的元素先发布，才会被块的析构函数销毁
+        publish_pending(tailBlock.load());
         std::atomic_thread_fence(std::memory_order_seq_cst);
         Block* frontBlock_ = frontBlock.load();
         Block* block = frontBlock_;
         do {
             Block* nextBlock = block->next_block();
-            block->~Block();
+            Block::destroy_block(block, allocator);
             block = nextBlock;
         } while (block != frontBlock_);
     }
 
-    template<typename T, size_t MAX_BLOCK_SIZE>
-    template<typename U>
-    bool ReaderWriterQueue<T, MAX_BLOCK_SIZE>::try_dequeue(U& result) {
-        ReentrantGuard guard(this->dequeuing);
+    template<typename T, size_t MAX_BLOCK_SIZE, typename Ordering, typename Allocator>
+    template<typename F>
+    bool ReaderWriterQueue<T, MAX_BLOCK_SIZE, Ordering, Allocator>::inner_dequeue(F&& consume) {
+        SQ_REENTRANT_GUARD(dequeuing);
 
         // 获取当前前端块和尾部状态
-        Block* frontBlock_ = frontBlock.load();
+        Block* frontBlock_ = frontBlock.load(Ordering::load_order);
         size_t blockTail = frontBlock_->get_local_tail();
         size_t blockFront = frontBlock_->get_front();
 
@@ -151,20 +405,21 @@ class alignas(CACHE_LINE_SIZE) ReaderWriterQueue
             std::atomic_thread_fence(std::memory_order_acquire);
             // 从非空的前端块中出队
             auto element = frontBlock_->get_element_at_idx(blockFront);
-            result = std::move(*element);
-            element->~T();
+            consume(*element);
+            destroy_element(element);
 
             blockFront = frontBlock_->forward(blockFront);
             std::atomic_thread_fence(std::memory_order_release);
             frontBlock_->store_front(blockFront);
+            SQ_STATS(record_dequeue(1, 0));
             return true;
             }
 
-        if (frontBlock_ != tailBlock.load())
+        if (frontBlock_ != tailBlock.load(Ordering::load_order))
             {  // 当前前端块为空但存在下一个块：
             std::atomic_thread_fence(std::memory_order_acquire);
 
-            frontBlock_ = frontBlock.load();
+            frontBlock_ = frontBlock.load(Ordering::load_order);
             blockTail = frontBlock_->get_local_tail_from_tail();
             blockFront = frontBlock_->get_front();
             std::atomic_thread_fence(std::memory_order_acquire);
@@ -172,33 +427,36 @@ class alignas(CACHE_LINE_SIZE) ReaderWriterQueue
             if (blockFront != blockTail)
                 {
                 auto element = frontBlock_->get_element_at_idx(blockFront);
-                result = std::move(*element);
-                element->~T();
+                consume(*element);
+                destroy_element(element);
 
                 blockFront = frontBlock_->forward(blockFront);
 
                 std::atomic_thread_fence(std::memory_order_release);
                 frontBlock_->store_front(blockFront);
+                SQ_STATS(record_dequeue(1, 0));
                 return true;
                 }
 
             Block* nextBlock = frontBlock_->next_block();
             size_t nextBlockFront = nextBlock->get_front();
-            size_t nextBlockTail = nextBlock->get_local_tail_from_tail();
+            [[maybe_unused]] size_t nextBlockTail = nextBlock->get_local_tail_from_tail();
 
             std::atomic_thread_fence(std::memory_order_acquire);
             assert(nextBlockFront != nextBlockTail);
             std::atomic_thread_fence(std::memory_order_release);
 
-            frontBlock = frontBlock_ = nextBlock;
+            frontBlock_ = nextBlock;
+            frontBlock.store(frontBlock_, Ordering::store_order);
             auto element = frontBlock_->get_element_at_idx(nextBlockFront);
-            result = std::move(*element);
-            element->~T();
+            consume(*element);
+            destroy_element(element);
 
             nextBlockFront = frontBlock_->forward(nextBlockFront);
 
             std::atomic_thread_fence(std::memory_order_release);
             frontBlock_->store_front(nextBlockFront);
+            SQ_STATS(record_dequeue(1, 1));
         } else { // 无可用块：
             return false;
         }
@@ -206,206 +464,1181 @@ class alignas(CACHE_LINE_SIZE) ReaderWriterQueue
         return true;
     }
 
-    template<typename T, size_t MAX_BLOCK_SIZE>
-    template<typename U>
-    bool ReaderWriterQueue<T, MAX_BLOCK_SIZE>::inner_enqueue(U&& element)
+    template<typename T, size_t MAX_BLOCK_SIZE, typename Ordering, typename Allocator>
+    T* ReaderWriterQueue<T, MAX_BLOCK_SIZE, Ordering, Allocator>::peek() const
+    {
+        SQ_REENTRANT_GUARD(dequeuing);
+
+        Block* frontBlock_ = frontBlock.load(Ordering::load_order);
+        size_t blockTail = frontBlock_->get_local_tail();
+        size_t blockFront = frontBlock_->get_front();
+
+        if (blockFront != blockTail || blockFront != frontBlock_->get_local_tail_from_tail())
+        {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return frontBlock_->get_element_at_idx(blockFront);
+        }
+
+        if (frontBlock_ != tailBlock.load(Ordering::load_order))
+        {   // 当前块已空但生产者已经前进到后面的块：重读最终的 tail，仍为空则元素在下一个块
+            std::atomic_thread_fence(std::memory_order_acquire);
+            frontBlock_ = frontBlock.load(Ordering::load_order);
+            blockTail = frontBlock_->get_local_tail_from_tail();
+            blockFront = frontBlock_->get_front();
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            if (blockFront != blockTail) return frontBlock_->get_element_at_idx(blockFront);
+
+            Block* nextBlock = frontBlock_->next_block();
+            size_t nextBlockFront = nextBlock->get_front();
+            std::atomic_thread_fence(std::memory_order_acquire);
+            assert(nextBlockFront != nextBlock->get_tail());
+            return nextBlock->get_element_at_idx(nextBlockFront);
+        }
+
+        return nullptr;
+    }
+
+    template<typename T, size_t MAX_BLOCK_SIZE, typename Ordering, typename Allocator>
+    template<typename ReaderWriterQueue<T, MAX_BLOCK_SIZE, Ordering, Allocator>::AllocationMode canAlloc, typename... Args>
+    bool ReaderWriterQueue<T, MAX_BLOCK_SIZE, Ordering, Allocator>::inner_enqueue(Args&&... args)
     {
-        ReentrantGuard guard(this->enqueuing);
+        SQ_REENTRANT_GUARD(enqueuing);
 
         // 获取当前尾部块的状态：
-        Block* tailBlock_ = tailBlock.load();
+        Block* tailBlock_ = tailBlock.load(Ordering::load_order);
         std::size_t blockFront = tailBlock_->get_local_front();
-        std::size_t blockTail = tailBlock_->get_tail();
+        std::size_t blockTail = pendingCount != 0 ? pendingTail : tailBlock_->get_tail();
         std::size_t nextBlockTail = tailBlock_->forward(blockTail);
 
         if(nextBlockTail != blockFront || nextBlockTail != tailBlock_->get_local_front_from_front())
         { // 检查尾部块是否有足够空间：
             std::atomic_thread_fence(std::memory_order_acquire);
-            tailBlock_->construct_element_at_idx(blockTail, std::forward<U>(element));
+            tailBlock_->construct_element_at_idx(blockTail, std::forward<Args>(args)...);
+            SQ_STATS(record_enqueue(1));  // 在发布之前计数，消费者能取到的元素一定已经计入 enqueued
 
-            std:std::atomic_thread_fence(std::memory_order_release);
+            if (publishBatch != 1)
+            {   // 延迟发布：只记录 tail，等批次攒满或 flush。默认逐个发布时完全不碰这些计数
+                if (++pendingCount < publishBatch)
+                {
+                    pendingTail = nextBlockTail;
+                    return true;
+                }
+                pendingCount = 0;
+            }
+            std::atomic_thread_fence(std::memory_order_release);
             tailBlock_->store_tail(nextBlockTail);
         }
         else
         {
+            SQ_STATS(producer_stat(TAIL_BLOCK_FULL));
             std::atomic_thread_fence(std::memory_order_acquire);
-            if(tailBlock_->next_block() != frontBlock)
+            if(next_block_free(tailBlock_))
             {
+                publish_pending(tailBlock_);
                 // 尾部块已满但存在下一个块：
                 std::atomic_thread_fence(std::memory_order_acquire);
                 Block* tailBlockNext = tailBlock_->next_block();
-                std::size_t nextBlockFront = tailBlockNext->get_local_front_from_front();
+                [[maybe_unused]] std::size_t nextBlockFront = tailBlockNext->get_local_front_from_front();
                 nextBlockTail = tailBlockNext->get_tail();
                 std::atomic_thread_fence(std::memory_order_acquire);
 
-                assert(nextBlockTail != nextBlockFront);
-                tailBlockNext->construct_element_at_idx(nextBlockTail, std::forward<U>(element));
+                assert(nextBlockTail == nextBlockFront);  // 不是前端块，必然已被消费者取空
+                tailBlockNext->construct_element_at_idx(nextBlockTail, std::forward<Args>(args)...);
+                SQ_STATS(record_enqueue(1));
 
                 tailBlockNext->store_tail(tailBlockNext->forward(nextBlockTail));
 
                 std::atomic_thread_fence(std::memory_order_release);
-                tailBlock = tailBlockNext;
+                tailBlock.store(tailBlockNext, Ordering::store_order);
+            }
+            else if constexpr (canAlloc == CannotAlloc)
+            {
+                return false;
             }
             else //  尾部块已满且没有可用块：
             {
-                auto newBlockSize = largestBlockSize >= MAX_BLOCK_SIZE ? largestBlockSize : largestBlockSize * 2;
-
-
-                Block* newBlock;
-                try
-                {
-                    newBlock = Block::make_block(newBlockSize);
-                }
-                catch (const std::bad_alloc& e)
-                {
-                    return false;
-                }
-
-                largestBlockSize = newBlockSize;
+                Block* newBlock = make_growth_block();
+                if (newBlock == nullptr) return false;
 
-                newBlock->construct_element_at_idx(0, std::forward<U>(element));
+                publish_pending(tailBlock_);
+                newBlock->construct_element_at_idx(0, std::forward<Args>(args)...);
+                SQ_STATS(record_enqueue(1));
                 assert(newBlock->get_front() == 0);
                 newBlock->store_tail(1);
-                auto tmp = newBlock->get_local_tail_from_tail();
 
                 newBlock->store_next(tailBlock_->next_block());
                 tailBlock_->store_next(newBlock);
 
                 std::atomic_thread_fence(std::memory_order_release);
-                tailBlock = newBlock;
+                tailBlock.store(newBlock, Ordering::store_order);
+            }
+        }
+        return true;
+    }
+
+    template<typename T, size_t MAX_BLOCK_SIZE, typename Ordering, typename Allocator>
+    template<typename ReaderWriterQueue<T, MAX_BLOCK_SIZE, Ordering, Allocator>::AllocationMode canAlloc>
+    T* ReaderWriterQueue<T, MAX_BLOCK_SIZE, Ordering, Allocator>::inner_reserve()
+    {
+        SQ_REENTRANT_GUARD(enqueuing);
+
+        Block* tailBlock_ = tailBlock.load(Ordering::load_order);
+        publish_pending(tailBlock_);
+        std::size_t blockFront = tailBlock_->get_local_front();
+        std::size_t blockTail = tailBlock_->get_tail();
+        std::size_t nextBlockTail = tailBlock_->forward(blockTail);
+
+        if (nextBlockTail != blockFront || nextBlockTail != tailBlock_->get_local_front_from_front())
+        {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            reservedBlock = tailBlock_;
+            return tailBlock_->get_element_at_idx(blockTail);
+        }
+
+        SQ_STATS(producer_stat(TAIL_BLOCK_FULL));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (next_block_free(tailBlock_))
+        {   // 尾部块已满，预留下一个（已被取空的）块的槽位，commit 时再移动 tailBlock
+            Block* tailBlockNext = tailBlock_->next_block();
+            [[maybe_unused]] std::size_t nextBlockFront = tailBlockNext->get_local_front_from_front();
+            nextBlockTail = tailBlockNext->get_tail();
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            assert(nextBlockTail == nextBlockFront);
+            reservedBlock = tailBlockNext;
+            return tailBlockNext->get_element_at_idx(nextBlockTail);
+        }
+
+        if constexpr (canAlloc == CannotAlloc)
+        {
+            return nullptr;
+        }
+        else
+        {   // 分配新块并作为空块链接在尾部块之后，发布之前消费者看不到它
+            Block* newBlock = make_growth_block();
+            if (newBlock == nullptr) return nullptr;
+
+            newBlock->store_next(tailBlock_->next_block());
+            tailBlock_->store_next(newBlock);
+
+            reservedBlock = newBlock;
+            return newBlock->get_element_at_idx(newBlock->get_tail());
+        }
+    }
+
+    template<typename T, size_t MAX_BLOCK_SIZE, typename Ordering, typename Allocator>
+    void ReaderWriterQueue<T, MAX_BLOCK_SIZE, Ordering, Allocator>::commit()
+    {
+        SQ_REENTRANT_GUARD(enqueuing);
+        assert(reservedBlock != nullptr);
+
+        Block* block = reservedBlock;
+        SQ_STATS(record_enqueue(1));
+        std::atomic_thread_fence(std::memory_order_release);
+        block->store_tail(block->forward(block->get_tail()));
+
+        if (block != tailBlock.load(Ordering::load_order)) {
+            std::atomic_thread_fence(std::memory_order_release);
+            tailBlock.store(block, Ordering::store_order);
+        }
+        reservedBlock = nullptr;
+    }
+
+    template<typename T, size_t MAX_BLOCK_SIZE, typename Ordering, typename Allocator>
+    template<typename ReaderWriterQueue<T, MAX_BLOCK_SIZE, Ordering, Allocator>::AllocationMode canAlloc, typename It>
+    bool ReaderWriterQueue<T, MAX_BLOCK_SIZE, Ordering, Allocator>::inner_enqueue_bulk(It first, size_t count)
+    {
+        SQ_REENTRANT_GUARD(enqueuing);
+        if (count == 0) return true;
+
+        // 统计尾部块与其后空闲块的剩余槽位，不够时在最后一个空闲块后面链接新块。
+        // 尾部块之后的块在 tailBlock 前移之前对消费者不可见，提前链接空块是安全的
+        Block* tailBlock_ = tailBlock.load(Ordering::load_order);
+        publish_pending(tailBlock_);
+        size_t available = (tailBlock_->get_local_front_from_front() - tailBlock_->get_tail() - 1) & tailBlock_->get_size_mask();
+
+        SQ_STATS(if (available < count) producer_stat(TAIL_BLOCK_FULL));
+        if (!link_free_blocks<canAlloc>(tailBlock_, available, count)) return false;
+
+        SQ_STATS(record_enqueue(count));
+
+        // 逐块填充：块内连续构造，一次 release 发布 tail；跨块时先发布新块的 tail 再移动 tailBlock
+        std::atomic_thread_fence(std::memory_order_acquire);
+        Block* block = tailBlock_;
+        while (true) {
+            size_t blockTail = block->get_tail();
+            size_t room = (block->get_local_front_from_front() - blockTail - 1) & block->get_size_mask();
+            size_t n = std::min(room, count);
+
+            if (n != 0) {
+                if constexpr (Block::trivial_element && is_contiguous_iterator_of_v<It, T>) {
+                    block->copy_in(blockTail, std::addressof(*first), n);
+                    first += n;
+                    blockTail = (blockTail + n) & block->get_size_mask();
+                } else {
+                    for (size_t i = 0; i != n; ++i, ++first) {
+                        block->construct_element_at_idx(blockTail, *first);
+                        blockTail = block->forward(blockTail);
+                    }
+                }
+                count -= n;
+
+                std::atomic_thread_fence(std::memory_order_release);
+                block->store_tail(blockTail);
+                if (block != tailBlock_) tailBlock.store(block, Ordering::store_order);
             }
+
+            if (count == 0) break;
+            block = block->next_block();
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+        return true;
+    }
+
+    template<typename T, size_t MAX_BLOCK_SIZE, typename Ordering, typename Allocator>
+    template<typename ReaderWriterQueue<T, MAX_BLOCK_SIZE, Ordering, Allocator>::AllocationMode canAlloc>
+    bool ReaderWriterQueue<T, MAX_BLOCK_SIZE, Ordering, Allocator>::link_free_blocks(Block* tailBlock_, size_t available, size_t count)
+    {
+        Block* lastBlock = tailBlock_;
+        while (available < count && next_block_free(lastBlock)) {
+            lastBlock = lastBlock->next_block();
+            available += lastBlock->get_size_mask();
+        }
+
+        if constexpr (canAlloc == CannotAlloc) {
+            if (available < count) return false;
+        }
+
+        while (available < count) {
+            Block* newBlock = make_growth_block();
+            if (newBlock == nullptr) return false;
+
+            newBlock->store_next(lastBlock->next_block());
+            lastBlock->store_next(newBlock);
+            lastBlock = newBlock;
+            available += newBlock->get_size_mask();
         }
         return true;
     }
 
-//
-// template<typename T, size_t MAX_BLOCK_SIZE = 512>
-// class BlockingReaderWriterQueue {
-// private:
-//     typedef ReaderWriterQueue<T, MAX_BLOCK_SIZE> ReaderWriterQueue;
-//
-// public:
-//     explicit BlockingReaderWriterQueue(size_t size = 15)
-//         : inner(size), sema(new spsc_sema::LightweightSemaphore()) {}
-//
-//     BlockingReaderWriterQueue(BlockingReaderWriterQueue&& other)
-//         : inner(std::move(other.inner)), sema(std::move(other.sema)) {}
-//
-//     BlockingReaderWriterQueue& operator=(BlockingReaderWriterQueue&& other) {
-//         std::swap(sema, other.sema);
-//         std::swap(inner, other.inner);
-//         return *this;
-//     }
-//
-//     bool try_enqueue(T const& element) {
-//         if (inner.try_enqueue(element)) {
-//             sema->signal();
-//             return true;
-//         }
-//         return false;
-//     }
-//
-//     bool try_enqueue(T&& element) {
-//         if (inner.try_enqueue(std::forward<T>(element))) {
-//             sema->signal();
-//             return true;
-//         }
-//         return false;
-//     }
-//
-//     template<typename... Args>
-//     bool try_emplace(Args&&... args) {
-//         if (inner.try_emplace(std::forward<Args>(args)...)) {
-//             sema->signal();
-//             return true;
-//         }
-//         return false;
-//     }
-//
-//     bool enqueue(T const& element) {
-//         if (inner.enqueue(element)) {
-//             sema->signal();
-//             return true;
-//         }
-//         return false;
-//     }
-//
-//     bool enqueue(T&& element) {
-//         if (inner.enqueue(std::forward<T>(element))) {
-//             sema->signal();
-//             return true;
-//         }
-//         return false;
-//     }
-//
-//     template<typename... Args>
-//     bool emplace(Args&&... args) {
-//         if (inner.emplace(std::forward<Args>(args)...)) {
-//             sema->signal();
-//             return true;
-//         }
-//         return false;
-//     }
-//
-//     template<typename U>
-//     bool try_dequeue(U& result) {
-//         if (sema->tryWait()) {
-//             bool success = inner.try_dequeue(result);
-//             assert(success);
-//             return true;
-//         }
-//         return false;
-//     }
-//
-//     template<typename U>
-//     void wait_dequeue(U& result) {
-//         while (!sema->wait());
-//         bool success = inner.try_dequeue(result);
-//         assert(success);
-//     }
-//
-//     template<typename U, typename Rep, typename Period>
-//     bool wait_dequeue_timed(U& result, std::chrono::duration<Rep, Period> const& timeout) {
-//         return wait_dequeue_timed(result, std::chrono::duration_cast<std::chrono::microseconds>(timeout).count());
-//     }
-//
-//     bool wait_dequeue_timed(U& result, std::int64_t timeout_usecs) {
-//         if (!sema->wait(timeout_usecs)) {
-//             return false;
-//         }
-//         bool success = inner.try_dequeue(result);
-//         assert(success);
-//         return success;
-//     }
-//
-//     T* peek() const {
-//         return inner.peek();
-//     }
-//
-//     bool pop() {
-//         if (sema->tryWait()) {
-//             bool result = inner.pop();
-//             assert(result);
-//             return true;
-//         }
-//         return false;
-//     }
-//
-//     size_t size_approx() const {
-//         return sema->availableApprox();
-//     }
-//
-//     size_t max_capacity() const {
-//         return inner.max_capacity();
-//     }
-//
-// private:
-//     BlockingReaderWriterQueue(BlockingReaderWriterQueue const&) = delete;
-//     BlockingReaderWriterQueue& operator=(BlockingReaderWriterQueue const&) = delete;
-//
-//     ReaderWriterQueue inner;
-//     std::unique_ptr<spsc_sema::LightweightSemaphore> sema;
-// };
+    template<typename T, size_t MAX_BLOCK_SIZE, typename Ordering, typename Allocator>
+    bool ReaderWriterQueue<T, MAX_BLOCK_SIZE, Ordering, Allocator>::reserve_capacity(size_t count)
+    {
+        SQ_REENTRANT_GUARD(enqueuing);
+        assert(reservedBlock == nullptr);
+
+        Block* tailBlock_ = tailBlock.load(Ordering::load_order);
+        size_t blockTail = pendingCount != 0 ? pendingTail : tailBlock_->get_tail();
+        size_t available = (tailBlock_->get_local_front_from_front() - blockTail - 1) & tailBlock_->get_size_mask();
+        return link_free_blocks<CanAlloc>(tailBlock_, available, count);
+    }
+
+    template<typename T, size_t MAX_BLOCK_SIZE, typename Ordering, typename Allocator>
+    template<typename It>
+    size_t ReaderWriterQueue<T, MAX_BLOCK_SIZE, Ordering, Allocator>::try_dequeue_bulk(It out, size_t max)
+    {
+        SQ_REENTRANT_GUARD(dequeuing);
+
+        size_t count = 0;
+        SQ_STATS(size_t hops = 0);
+        while (count != max) {
+            Block* frontBlock_ = frontBlock.load(Ordering::load_order);
+            size_t blockFront = frontBlock_->get_front();
+            size_t blockTail = frontBlock_->get_local_tail();
+            if (blockFront == blockTail) blockTail = frontBlock_->get_local_tail_from_tail();
+
+            if (blockFront == blockTail) {
+                if (frontBlock_ == tailBlock.load(Ordering::load_order)) break;  // 队列已空
+
+                // 生产者已离开此块，重新读取它最终的 tail；仍为空则前进到下一个块
+                std::atomic_thread_fence(std::memory_order_acquire);
+                blockTail = frontBlock_->get_local_tail_from_tail();
+                if (blockFront == blockTail) {
+                    std::atomic_thread_fence(std::memory_order_release);
+                    frontBlock.store(frontBlock_->next_block(), Ordering::store_order);
+                    SQ_STATS(++hops);
+                    continue;
+                }
+            }
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if constexpr (Block::trivial_element && is_contiguous_iterator_of_v<It, T> &&
+                          std::is_same_v<decltype(std::addressof(*out)), T*>) {
+                size_t n = std::min((blockTail - blockFront) & frontBlock_->get_size_mask(), max - count);
+                frontBlock_->copy_out(blockFront, std::addressof(*out), n);
+                out += n;
+                count += n;
+                blockFront = (blockFront + n) & frontBlock_->get_size_mask();
+            } else {
+                try {
+                    for (; blockFront != blockTail && count != max; ++count, ++out) {
+                        auto element = frontBlock_->get_element_at_idx(blockFront);
+                        *out = std::move(*element);
+                        destroy_element(element);
+                        blockFront = frontBlock_->forward(blockFront);
+                    }
+                } catch (...) {
+                    // 移动赋值抛出异常：已经销毁的槽位必须先发布出去，抛出异常的元素仍留在队列里
+                    std::atomic_thread_fence(std::memory_order_release);
+                    frontBlock_->store_front(blockFront);
+                    SQ_STATS(record_dequeue(count, hops));
+                    throw;
+                }
+            }
+
+            std::atomic_thread_fence(std::memory_order_release);
+            frontBlock_->store_front(blockFront);
+        }
+        SQ_STATS(if (count != 0 || hops != 0) record_dequeue(count, hops));
+        return count;
+    }
+
+    template<typename T, size_t MAX_BLOCK_SIZE, typename Ordering, typename Allocator>
+    template<typename F>
+    size_t ReaderWriterQueue<T, MAX_BLOCK_SIZE, Ordering, Allocator>::consume_up_to(size_t max, F&& f)
+    {
+        SQ_REENTRANT_GUARD(dequeuing);
+
+        // 快照之前的块生产者都已离开，它们的 tail 在 tailBlock 发布之前写入，已是最终值
+        Block* lastBlock = tailBlock.load(Ordering::load_order);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        size_t lastTail = lastBlock->get_local_tail_from_tail();
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        Block* firstBlock = frontBlock.load(Ordering::load_order);
+        Block* block = firstBlock;
+        size_t count = 0;
+        SQ_STATS(size_t hops = 0);
+        while (true) {
+            const size_t initialFront = block->get_front();
+            size_t blockFront = initialFront;
+            size_t blockTail = block == lastBlock ? lastTail : block->get_local_tail_from_tail();
+            try {
+                for (; blockFront != blockTail && count != max; ++count) {
+                    auto element = block->get_element_at_idx(blockFront);
+                    f(*element);
+                    destroy_element(element);
+                    blockFront = block->forward(blockFront);
+                }
+            } catch (...) {
+                // 回调抛出异常：发布已经处理并销毁的元素，抛出异常的元素及其后的元素仍留在队列里
+                if (blockFront != initialFront) {
+                    std::atomic_thread_fence(std::memory_order_release);
+                    block->store_front(blockFront);
+                }
+                if (block != firstBlock) frontBlock.store(block, Ordering::store_order);
+                SQ_STATS(record_dequeue(count, hops));
+                throw;
+            }
+
+            // 先发布离开的块的 front，生产者只会把 frontBlock 之前、front == tail 的块当作空闲块
+            if (blockFront != initialFront) {
+                std::atomic_thread_fence(std::memory_order_release);
+                block->store_front(blockFront);
+            }
+            if (block == lastBlock || count == max) break;
+            block = block->next_block();
+            SQ_STATS(++hops);
+        }
+
+        if (block != firstBlock) frontBlock.store(block, Ordering::store_order);
+        SQ_STATS(if (count != 0 || hops != 0) record_dequeue(count, hops));
+        return count;
+    }
+
+    template<typename T, size_t MAX_BLOCK_SIZE, typename Ordering, typename Allocator>
+    size_t ReaderWriterQueue<T, MAX_BLOCK_SIZE, Ordering, Allocator>::size_approx() const
+    {   // 元素只可能位于前端块到尾部块之间，这一段不会被 shrink_to 释放
+        size_t result = 0;
+        Block* block = frontBlock.load(Ordering::load_order);
+        Block* tailBlock_ = tailBlock.load(Ordering::load_order);
+        while (true) {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            size_t blockFront = block->get_front();
+            size_t blockTail = block->get_tail();
+            result += (blockTail - blockFront) & block->get_size_mask();
+            if (block == tailBlock_) break;
+            block = block->next_block();
+        }
+        return result;
+    }
+
+    template<typename T, size_t MAX_BLOCK_SIZE, typename Ordering, typename Allocator>
+    size_t ReaderWriterQueue<T, MAX_BLOCK_SIZE, Ordering, Allocator>::shrink_to(size_t retained)
+    {
+        SQ_REENTRANT_GUARD(enqueuing);
+        assert(reservedBlock == nullptr);
+
+        // 尾部块之后、前端块之前的块消费者已经离开且不会再访问（frontBlock 只会朝 tailBlock 前进），
+        // 读到最新的 frontBlock 后，这些块中元素的析构对生产者可见，可以直接摘下释放
+        Block* tailBlock_ = tailBlock.load(Ordering::load_order);
+        cachedFrontBlock = frontBlock.load(Ordering::load_order);
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        size_t capacity = totalCapacity.load(std::memory_order_relaxed);
+        while (capacity > retained && tailBlock_->next_block() != cachedFrontBlock) {
+            Block* victim = tailBlock_->next_block();
+            tailBlock_->store_next(victim->next_block());
+            capacity -= victim->get_size_mask();
+            Block::destroy_block(victim, allocator);
+        }
+
+        totalCapacity.store(capacity, std::memory_order_relaxed);
+        return capacity;
+    }
+
+    // 容量在编译期确定的 SPSC 环：单个连续的 2 的幂数组，没有 Block 链表和 frontBlock/tailBlock 间接层。
+    // front/tail 是不回绕的计数器，下标用 constexpr 掩码取得，N 个槽位都能使用；
+    // 与 Block 一样，两端各自缓存对方的下标（local_tail / local_front），只在看起来空/满时才读对方的缓存行。
+    // 接口与 ReaderWriterQueue 兼容，可以用 typedef 互换：不会扩容，enqueue/reserve 在满时与 try_ 版本一样失败
+    template<typename T, size_t N, typename Ordering = DefaultOrdering>
+    class alignas(CACHE_LINE_SIZE) FixedRing
+    {
+        static_assert(N >= 2 && (N & (N - 1)) == 0, "FixedRing 的容量必须是 2 的幂");
+
+        public:
+            enum AllocationMode {CanAlloc, CannotAlloc};
+
+            // size 只用于与 ReaderWriterQueue(size) 兼容，不能超过 N
+            explicit FixedRing(size_t size = N) {(void)size; assert(size <= N);}
+
+            FixedRing(const FixedRing&) = delete;
+            FixedRing& operator=(const FixedRing&) = delete;
+
+            ~FixedRing();
+
+            template<typename U>
+            bool try_dequeue(U& result) {return inner_dequeue([&result](T& element) {result = std::move(element);});}
+
+            template<typename U, typename Strategy>
+            void dequeue_wait(U& result, Strategy&& strategy) {strategy.wait([this, &result]() {return try_dequeue(result);});}
+
+            T* peek() const;
+
+            bool pop() {return inner_dequeue([](T&) {});}
+
+            // canAlloc 只为与 ReaderWriterQueue 保持相同的调用方式，两种模式行为相同
+            template<AllocationMode canAlloc = CanAlloc, typename... Args>
+            bool inner_enqueue(Args&&... args);
+
+            template<typename... Args>
+            bool try_emplace(Args&&... args) {return inner_enqueue<CannotAlloc>(std::forward<Args>(args)...);}
+
+            template<typename... Args>
+            bool emplace(Args&&... args) {return inner_enqueue<CanAlloc>(std::forward<Args>(args)...);}
+
+            template<typename U>
+            bool try_enqueue(U&& element) {return inner_enqueue<CannotAlloc>(std::forward<U>(element));}
+
+            template<typename U>
+            bool enqueue(U&& element) {return inner_enqueue<CanAlloc>(std::forward<U>(element));}
+
+            // 全部放得下才入队，只做一次 tail 发布
+            template<typename It>
+            bool try_enqueue_bulk(It first, size_t count);
+
+            template<typename It>
+            bool enqueue_bulk(It first, size_t count) {return try_enqueue_bulk(first, count);}
+
+            T* try_reserve();
+            T* reserve() {return try_reserve();}
+            void commit();
+
+            template<typename It>
+            size_t try_dequeue_bulk(It out, size_t max);
+
+            template<typename F>
+            size_t consume_up_to(size_t max, F&& f);
+
+            template<typename F>
+            size_t consume_all(F&& f) {return consume_up_to(SIZE_MAX, std::forward<F>(f));}
+
+            [[nodiscard]] static constexpr size_t max_capacity() {return N;}
+
+            [[nodiscard]] size_t size_approx() const
+            {
+                size_t front_ = front.load(Ordering::load_order);
+                return tail.load(Ordering::load_order) - front_;
+            }
+
+            // 存储是内联的，没有可以释放的块
+            size_t shrink_to(size_t) {return N;}
+
+        private:
+            static constexpr size_t MASK = N - 1;
+
+            T* element_at(size_t idx) const {return reinterpret_cast<T*>(const_cast<char*>(data) + (idx & MASK) * sizeof(T));}
+
+            template<typename F>
+            bool inner_dequeue(F&& consume);
+
+            // 消费者拥有的状态
+            alignas(CACHE_LINE_SIZE) std::atomic<size_t> front{0};  // 下一个出队的位置
+            mutable size_t local_tail{0};  // 消费者缓存的 tail，只在看起来为空时刷新
+#if SQ_DEBUG_CHECKS
+            mutable std::atomic<bool> dequeuing{false};
+#endif
+
+            // 生产者拥有的状态
+            alignas(CACHE_LINE_SIZE) std::atomic<size_t> tail{0};  // 下一个入队的位置
+            size_t local_front{0};  // 生产者缓存的 front，只在看起来已满时刷新
+            bool reserved{false};
+#if SQ_DEBUG_CHECKS
+            std::atomic<bool> enqueuing{false};
+#endif
+
+            alignas(std::max(CACHE_LINE_SIZE, alignof(T))) char data[N * sizeof(T)];
+    };
+
+    template<typename T, size_t N, typename Ordering>
+    FixedRing<T, N, Ordering>::~FixedRing()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        size_t tail_ = tail.load(std::memory_order_relaxed);
+        for (size_t i = front.load(std::memory_order_relaxed); i != tail_; ++i)
+            element_at(i)->~T();
+    }
+
+    template<typename T, size_t N, typename Ordering>
+    template<typename F>
+    bool FixedRing<T, N, Ordering>::inner_dequeue(F&& consume)
+    {
+        SQ_REENTRANT_GUARD(dequeuing);
+
+        size_t front_ = front.load(std::memory_order_relaxed);
+        if (front_ == local_tail)
+        {
+            local_tail = tail.load(Ordering::load_order);
+            if (front_ == local_tail) return false;
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        T* element = element_at(front_);
+        consume(*element);
+        destroy_element(element);
+
+        std::atomic_thread_fence(std::memory_order_release);
+        front.store(front_ + 1, Ordering::store_order);
+        return true;
+    }
+
+    template<typename T, size_t N, typename Ordering>
+    T* FixedRing<T, N, Ordering>::peek() const
+    {
+        SQ_REENTRANT_GUARD(dequeuing);
+
+        size_t front_ = front.load(std::memory_order_relaxed);
+        if (front_ == local_tail)
+        {
+            local_tail = tail.load(Ordering::load_order);
+            if (front_ == local_tail) return nullptr;
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return element_at(front_);
+    }
+
+    template<typename T, size_t N, typename Ordering>
+    template<typename FixedRing<T, N, Ordering>::AllocationMode canAlloc, typename... Args>
+    bool FixedRing<T, N, Ordering>::inner_enqueue(Args&&... args)
+    {
+        SQ_REENTRANT_GUARD(enqueuing);
+        assert(!reserved);
+
+        size_t tail_ = tail.load(std::memory_order_relaxed);
+        if (tail_ - local_front == N)
+        {
+            local_front = front.load(Ordering::load_order);
+            if (tail_ - local_front == N) return false;
+        }
+
+        // 与 Block 相同：确认槽位空闲后的 acquire 保证消费者对旧元素的析构先于这里的构造
+        std::atomic_thread_fence(std::memory_order_acquire);
+        new (element_at(tail_)) T(std::forward<Args>(args)...);
+
+        std::atomic_thread_fence(std::memory_order_release);
+        tail.store(tail_ + 1, Ordering::store_order);
+        return true;
+    }
+
+    template<typename T, size_t N, typename Ordering>
+    template<typename It>
+    bool FixedRing<T, N, Ordering>::try_enqueue_bulk(It first, size_t count)
+    {
+        SQ_REENTRANT_GUARD(enqueuing);
+        assert(!reserved);
+
+        size_t tail_ = tail.load(std::memory_order_relaxed);
+        if (N - (tail_ - local_front) < count)
+        {
+            local_front = front.load(Ordering::load_order);
+            if (N - (tail_ - local_front) < count) return false;
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        for (size_t i = 0; i < count; ++i, ++first)
+            new (element_at(tail_ + i)) T(*first);
+
+        std::atomic_thread_fence(std::memory_order_release);
+        tail.store(tail_ + count, Ordering::store_order);
+        return true;
+    }
+
+    template<typename T, size_t N, typename Ordering>
+    T* FixedRing<T, N, Ordering>::try_reserve()
+    {
+        SQ_REENTRANT_GUARD(enqueuing);
+        assert(!reserved);
+
+        size_t tail_ = tail.load(std::memory_order_relaxed);
+        if (tail_ - local_front == N)
+        {
+            local_front = front.load(Ordering::load_order);
+            if (tail_ - local_front == N) return nullptr;
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        reserved = true;
+        return element_at(tail_);
+    }
+
+    template<typename T, size_t N, typename Ordering>
+    void FixedRing<T, N, Ordering>::commit()
+    {
+        SQ_REENTRANT_GUARD(enqueuing);
+        assert(reserved);
+
+        reserved = false;
+        std::atomic_thread_fence(std::memory_order_release);
+        tail.store(tail.load(std::memory_order_relaxed) + 1, Ordering::store_order);
+    }
+
+    template<typename T, size_t N, typename Ordering>
+    template<typename It>
+    size_t FixedRing<T, N, Ordering>::try_dequeue_bulk(It out, size_t max)
+    {
+        SQ_REENTRANT_GUARD(dequeuing);
+
+        size_t front_ = front.load(std::memory_order_relaxed);
+        if (local_tail - front_ < max) local_tail = tail.load(Ordering::load_order);
+
+        size_t count = std::min(local_tail - front_, max);
+        if (count == 0) return 0;
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        size_t i = 0;
+        try {
+            for (; i < count; ++i, ++out)
+            {
+                T* element = element_at(front_ + i);
+                *out = std::move(*element);
+                destroy_element(element);
+            }
+        } catch (...) {
+            // 移动赋值抛出异常：已经销毁的槽位必须先发布出去，抛出异常的元素仍留在队列里
+            std::atomic_thread_fence(std::memory_order_release);
+            front.store(front_ + i, Ordering::store_order);
+            throw;
+        }
+
+        std::atomic_thread_fence(std::memory_order_release);
+        front.store(front_ + count, Ordering::store_order);
+        return count;
+    }
+
+    template<typename T, size_t N, typename Ordering>
+    template<typename F>
+    size_t FixedRing<T, N, Ordering>::consume_up_to(size_t max, F&& f)
+    {
+        SQ_REENTRANT_GUARD(dequeuing);
+
+        size_t front_ = front.load(std::memory_order_relaxed);
+        local_tail = tail.load(Ordering::load_order);
+        size_t count = std::min(local_tail - front_, max);
+        if (count == 0) return 0;
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        size_t i = 0;
+        try {
+            for (; i != count; ++i) {
+                T* element = element_at(front_ + i);
+                f(*element);
+                destroy_element(element);
+            }
+        } catch (...) {
+            // 回调抛出异常：发布已经处理并销毁的元素，抛出异常的元素及其后的元素仍留在队列里
+            std::atomic_thread_fence(std::memory_order_release);
+            front.store(front_ + i, Ordering::store_order);
+            throw;
+        }
+
+        std::atomic_thread_fence(std::memory_order_release);
+        front.store(front_ + count, Ordering::store_order);
+        return count;
+    }
+
+    // 在 ReaderWriterQueue 外包一层轻量信号量：信号量计数等于已发布的元素数，
+    // 消费者没有数据时先短暂自旋，再在 futex 上睡眠，而不是一直空转
+    template<typename T, size_t MAX_BLOCK_SIZE = 512, typename Ordering = DefaultOrdering, typename Allocator = MallocBlockAllocator>
+    class BlockingReaderWriterQueue
+    {
+        private:
+            using ReaderWriterQueue = sq::ReaderWriterQueue<T, MAX_BLOCK_SIZE, Ordering, Allocator>;
+
+        public:
+            explicit BlockingReaderWriterQueue(size_t size = 15, const Allocator& _allocator = Allocator())
+                : inner(size, _allocator), sema(new spsc_sema::LightweightSemaphore()) {}
+
+            BlockingReaderWriterQueue(BlockingReaderWriterQueue&& other) noexcept
+                : inner(std::move(other.inner)), sema(std::move(other.sema)) {}
+
+            BlockingReaderWriterQueue& operator=(BlockingReaderWriterQueue&& other) noexcept
+            {
+                std::swap(sema, other.sema);
+                std::swap(inner, other.inner);
+                return *this;
+            }
+
+            BlockingReaderWriterQueue(const BlockingReaderWriterQueue&) = delete;
+            BlockingReaderWriterQueue& operator=(const BlockingReaderWriterQueue&) = delete;
+
+            template<typename U>
+            bool try_enqueue(U&& element)
+            {
+                if (inner.try_enqueue(std::forward<U>(element))) {
+                    sema->signal();
+                    return true;
+                }
+                return false;
+            }
+
+            template<typename U>
+            bool enqueue(U&& element)
+            {
+                if (inner.enqueue(std::forward<U>(element))) {
+                    sema->signal();
+                    return true;
+                }
+                return false;
+            }
+
+            template<typename... Args>
+            bool try_emplace(Args&&... args)
+            {
+                if (inner.try_emplace(std::forward<Args>(args)...)) {
+                    sema->signal();
+                    return true;
+                }
+                return false;
+            }
+
+            template<typename... Args>
+            bool emplace(Args&&... args)
+            {
+                if (inner.emplace(std::forward<Args>(args)...)) {
+                    sema->signal();
+                    return true;
+                }
+                return false;
+            }
+
+            T* try_reserve() {return inner.try_reserve();}
+            T* reserve() {return inner.reserve();}
+
+            void commit()
+            {
+                inner.commit();
+                sema->signal();
+            }
+
+            template<typename It>
+            bool try_enqueue_bulk(It first, size_t count)
+            {
+                if (inner.try_enqueue_bulk(first, count)) {
+                    sema->signal(static_cast<spsc_sema::LightweightSemaphore::ssize_t>(count));
+                    return true;
+                }
+                return false;
+            }
+
+            template<typename It>
+            bool enqueue_bulk(It first, size_t count)
+            {
+                if (inner.enqueue_bulk(first, count)) {
+                    sema->signal(static_cast<spsc_sema::LightweightSemaphore::ssize_t>(count));
+                    return true;
+                }
+                return false;
+            }
+
+            template<typename U>
+            bool try_dequeue(U& result)
+            {
+                if (sema->tryWait()) {
+                    bool success = inner.try_dequeue(result);
+                    assert(success);
+                    return true;
+                }
+                return false;
+            }
+
+            template<typename U>
+            void wait_dequeue(U& result)
+            {
+                while (!sema->wait());
+                [[maybe_unused]] bool success = inner.try_dequeue(result);
+                assert(success);
+            }
+
+            template<typename U, typename Rep, typename Period>
+            bool wait_dequeue_timed(U& result, std::chrono::duration<Rep, Period> const& timeout)
+            {
+                return wait_dequeue_timed(result, std::chrono::duration_cast<std::chrono::microseconds>(timeout).count());
+            }
+
+            // timeout_usecs < 0 表示无限等待
+            template<typename U>
+            bool wait_dequeue_timed(U& result, std::int64_t timeout_usecs)
+            {
+                if (!sema->wait(timeout_usecs)) {
+                    return false;
+                }
+                bool success = inner.try_dequeue(result);
+                assert(success);
+                return success;
+            }
+
+            // 只有信号量中确有计数时才保证 peek 到的元素存在
+            T* peek() const
+            {
+                return inner.peek();
+            }
+
+            bool pop()
+            {
+                if (sema->tryWait()) {
+                    bool result = inner.pop();
+                    assert(result);
+                    return true;
+                }
+                return false;
+            }
+
+            [[nodiscard]] size_t size_approx() const
+            {
+                return sema->availableApprox();
+            }
+
+            [[nodiscard]] size_t max_capacity() const
+            {
+                return inner.max_capacity();
+            }
+
+            size_t shrink_to(size_t retained)
+            {
+                return inner.shrink_to(retained);
+            }
+
+            bool reserve_capacity(size_t count)
+            {
+                return inner.reserve_capacity(count);
+            }
+
+#if SQ_ENABLE_STATS
+            [[nodiscard]] QueueStats stats() const {return inner.stats();}
+#endif
+
+        private:
+            ReaderWriterQueue inner;
+            std::unique_ptr<spsc_sema::LightweightSemaphore> sema;
+    };
+
+#if SQ_HAS_COROUTINES
+    // 可以 co_await 的 SPSC 队列：co_await queue.dequeue() 在队列为空时挂起消费者协程，
+    // 生产者下一次入队成功后通过单等待者槽位取出协程句柄并就地恢复它（恢复发生在生产者线程上）。
+    // 与 BlockingReaderWriterQueue 一样包在 ReaderWriterQueue 外面，不需要等待的队列入队路径上没有额外的栅栏
+    template<typename T, size_t MAX_BLOCK_SIZE = 512, typename Ordering = DefaultOrdering, typename Allocator = MallocBlockAllocator>
+    class AwaitableReaderWriterQueue
+    {
+        private:
+            using ReaderWriterQueue = sq::ReaderWriterQueue<T, MAX_BLOCK_SIZE, Ordering, Allocator>;
+
+        public:
+            class DequeueAwaiter
+            {
+                public:
+                    explicit DequeueAwaiter(AwaitableReaderWriterQueue& _queue) : queue(_queue) {}
+
+                    bool await_ready() const {return queue.inner.peek() != nullptr;}
+
+                    // 先登记句柄再复查。登记之后生产者随时可能恢复协程并销毁本等待体，
+                    // 所以这里只使用局部变量，复查也只读原子量（size_approx），不碰消费者的本地状态
+                    bool await_suspend(std::coroutine_handle<> handle)
+                    {
+                        AwaitableReaderWriterQueue& queue_ = queue;
+                        queue_.waiter.store(handle.address(), std::memory_order_release);
+                        std::atomic_thread_fence(std::memory_order_seq_cst);
+                        if (queue_.inner.size_approx() != 0) {
+                            // 抢回句柄则不挂起；抢不回说明生产者已经取走，会负责恢复
+                            return queue_.waiter.exchange(nullptr, std::memory_order_acq_rel) == nullptr;
+                        }
+                        return true;
+                    }
+
+                    T await_resume()
+                    {
+                        T* element = queue.inner.peek();
+                        assert(element != nullptr);
+                        T result(std::move(*element));
+                        queue.inner.pop();
+                        return result;
+                    }
+
+                private:
+                    AwaitableReaderWriterQueue& queue;
+            };
+
+            explicit AwaitableReaderWriterQueue(size_t size = 15, const Allocator& _allocator = Allocator())
+                : inner(size, _allocator) {}
+
+            AwaitableReaderWriterQueue(const AwaitableReaderWriterQueue&) = delete;
+            AwaitableReaderWriterQueue& operator=(const AwaitableReaderWriterQueue&) = delete;
+
+            template<typename U>
+            bool try_enqueue(U&& element) {return resume_if(inner.try_enqueue(std::forward<U>(element)));}
+
+            template<typename U>
+            bool enqueue(U&& element) {return resume_if(inner.enqueue(std::forward<U>(element)));}
+
+            template<typename... Args>
+            bool try_emplace(Args&&... args) {return resume_if(inner.try_emplace(std::forward<Args>(args)...));}
+
+            template<typename... Args>
+            bool emplace(Args&&... args) {return resume_if(inner.emplace(std::forward<Args>(args)...));}
+
+            T* try_reserve() {return inner.try_reserve();}
+            T* reserve() {return inner.reserve();}
+            void commit() {inner.commit(); resume_if(true);}
+
+            template<typename It>
+            bool try_enqueue_bulk(It first, size_t count) {return resume_if(inner.try_enqueue_bulk(first, count));}
+
+            template<typename It>
+            bool enqueue_bulk(It first, size_t count) {return resume_if(inner.enqueue_bulk(first, count));}
+
+            // 同一时刻只能有一个协程在等待
+            DequeueAwaiter dequeue() {return DequeueAwaiter(*this);}
+
+            template<typename U>
+            bool try_dequeue(U& result) {return inner.try_dequeue(result);}
+
+            T* peek() const {return inner.peek();}
+            bool pop() {return inner.pop();}
+
+            [[nodiscard]] size_t size_approx() const {return inner.size_approx();}
+            [[nodiscard]] size_t max_capacity() const {return inner.max_capacity();}
+            size_t shrink_to(size_t retained) {return inner.shrink_to(retained);}
+            bool reserve_capacity(size_t count) {return inner.reserve_capacity(count);}
+
+#if SQ_ENABLE_STATS
+            [[nodiscard]] QueueStats stats() const {return inner.stats();}
+#endif
+
+        private:
+            // 元素发布之后调用：与 await_suspend 各用一个 seq_cst 栅栏，保证不会双方都错过对方
+            bool resume_if(bool enqueued)
+            {
+                if (!enqueued) return false;
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (waiter.load(std::memory_order_relaxed) != nullptr) {
+                    void* handle = waiter.exchange(nullptr, std::memory_order_acq_rel);
+                    if (handle != nullptr) std::coroutine_handle<>::from_address(handle).resume();
+                }
+                return true;
+            }
+
+            ReaderWriterQueue inner;
+            alignas(CACHE_LINE_SIZE) std::atomic<void*> waiter{nullptr};  // 单等待者槽位，存放挂起的协程句柄
+    };
+#endif
+
+    // 变长字节消息的 SPSC 通道：所有记录连续存放在一个 Block<char> 中，沿用 Block 的 front/tail 协议。
+    // 每条记录是 8 字节长度头 + 按 8 字节对齐的负载；尾部放不下时写一个回绕标记，记录从缓冲区开头继续，
+    // 所以每条记录在内存中总是连续的。生产者 try_reserve(n) 后直接写入负载再 commit，消费者通过 peek
+    // 拿到指向缓冲区内部的视图，用完后 pop，整个过程不需要为每条消息单独分配内存或额外拷贝
+    template<typename Ordering = DefaultOrdering, typename Allocator = MallocBlockAllocator>
+    class ByteChannel
+    {
+        public:
+            using Block = sq::Block<char, Ordering>;
+
+            // capacity 向上取整为 2 的幂（至少 64 字节）
+            explicit ByteChannel(size_t capacity = 4096, const Allocator& _allocator = Allocator())
+            : allocator(_allocator)
+            {
+                size_t size = 64;
+                while (size < capacity) size <<= 1;
+                block = Block::make_block(size, allocator);
+            }
+
+            ByteChannel(const ByteChannel&) = delete;
+            ByteChannel& operator=(const ByteChannel&) = delete;
+
+            ~ByteChannel() {Block::destroy_block(block, allocator);}
+
+            // 不论读写位置在哪里都保证最终能放下的最大记录长度
+            [[nodiscard]] size_t max_record_size() const {return (block->get_size_mask() + 1) / 2 - HEADER_SIZE;}
+
+            // 预留 n 字节的连续负载空间，空间不足或 n 超过 max_record_size 时返回 nullptr。
+            // 写完后调用 commit 发布，预留与提交之间不能有其他写操作
+            char* try_reserve(size_t n);
+
+            // 发布最近一次预留的记录，实际长度 n 不能超过预留的长度
+            void commit(size_t n);
+
+            bool try_write(const void* bytes, size_t n)
+            {
+                char* dest = try_reserve(n);
+                if (dest == nullptr) return false;
+                std::memcpy(dest, bytes, n);
+                commit(n);
+                return true;
+            }
+
+            // 取得队首记录的视图（不移出），通道为空返回 false；视图在 pop 之前有效
+            bool peek(std::string_view& record);
+
+            // 丢弃队首记录，把它占用的空间还给生产者
+            bool pop();
+
+            // 对队首记录调用 consume(std::string_view) 后将其移出
+            template<typename F>
+            bool try_consume(F&& consume)
+            {
+                std::string_view record;
+                if (!peek(record)) return false;
+                consume(record);
+                return pop();
+            }
+
+        private:
+            static constexpr size_t HEADER_SIZE = sizeof(std::uint64_t);
+            static constexpr std::uint64_t WRAP_MARKER = ~std::uint64_t(0);
+
+            static constexpr size_t record_size(size_t n) {return HEADER_SIZE + ((n + HEADER_SIZE - 1) & ~(HEADER_SIZE - 1));}
+
+            std::uint64_t read_header(size_t offset) const
+            {
+                std::uint64_t header;
+                std::memcpy(&header, block->get_element_at_idx(offset), HEADER_SIZE);
+                return header;
+            }
+
+            void write_header(size_t offset, std::uint64_t header) {std::memcpy(block->get_element_at_idx(offset), &header, HEADER_SIZE);}
+
+            // 跳过回绕标记，找到队首记录的位置，通道为空返回 false
+            bool front_record(size_t& offset, std::uint64_t& length);
+
+            Block* block;  // 只在构造和析构时修改
+            Allocator allocator;
+
+            // 生产者拥有的状态
+            alignas(CACHE_LINE_SIZE) size_t reservedOffset{0};  // 预留记录的长度头位置
+            size_t reservedLength{0};
+            bool reserved{false};
+#if SQ_DEBUG_CHECKS
+            std::atomic<bool> enqueuing{false};
+            alignas(CACHE_LINE_SIZE) std::atomic<bool> dequeuing{false};
+#endif
+    };
+
+    template<typename Ordering, typename Allocator>
+    char* ByteChannel<Ordering, Allocator>::try_reserve(size_t n)
+    {
+        SQ_REENTRANT_GUARD(enqueuing);
+        assert(!reserved);
+        if (n > max_record_size()) return nullptr;
+
+        // 所有记录都是 8 字节的整数倍，容量也是，所以 tail 之后至少还有一个长度头的位置可以写回绕标记
+        size_t capacity = block->get_size_mask() + 1;
+        size_t blockTail = block->get_tail();
+        size_t need = record_size(n);
+        size_t toEnd = capacity - blockTail;
+        size_t required = need <= toEnd ? need : toEnd + need;
+
+        if (((block->get_local_front() - blockTail - 1) & block->get_size_mask()) < required &&
+            ((block->get_local_front_from_front() - blockTail - 1) & block->get_size_mask()) < required)
+            return nullptr;
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        reservedOffset = blockTail;
+        if (need > toEnd) {
+            // 标记在 commit 移动 tail 时和记录一起发布
+            write_header(blockTail, WRAP_MARKER);
+            reservedOffset = 0;
+        }
+        reservedLength = n;
+        reserved = true;
+        return block->get_element_at_idx(reservedOffset + HEADER_SIZE);
+    }
+
+    template<typename Ordering, typename Allocator>
+    void ByteChannel<Ordering, Allocator>::commit(size_t n)
+    {
+        SQ_REENTRANT_GUARD(enqueuing);
+        assert(reserved && n <= reservedLength);
+
+        write_header(reservedOffset, n);
+        reserved = false;
+
+        std::atomic_thread_fence(std::memory_order_release);
+        block->store_tail((reservedOffset + record_size(n)) & block->get_size_mask());
+    }
+
+    template<typename Ordering, typename Allocator>
+    bool ByteChannel<Ordering, Allocator>::front_record(size_t& offset, std::uint64_t& length)
+    {
+        offset = block->get_front();
+        if (offset == block->get_local_tail() && offset == block->get_local_tail_from_tail()) return false;
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        length = read_header(offset);
+        if (length == WRAP_MARKER) {
+            // 回绕标记与其后的记录由同一次 commit 发布，跳过标记后一定还有记录
+            offset = 0;
+            std::atomic_thread_fence(std::memory_order_release);
+            block->store_front(0);
+            assert(block->get_local_tail() != 0);
+            length = read_header(0);
+        }
+        return true;
+    }
+
+    template<typename Ordering, typename Allocator>
+    bool ByteChannel<Ordering, Allocator>::peek(std::string_view& record)
+    {
+        SQ_REENTRANT_GUARD(dequeuing);
+
+        size_t offset;
+        std::uint64_t length;
+        if (!front_record(offset, length)) return false;
+        record = std::string_view(block->get_element_at_idx(offset + HEADER_SIZE), length);
+        return true;
+    }
+
+    template<typename Ordering, typename Allocator>
+    bool ByteChannel<Ordering, Allocator>::pop()
+    {
+        SQ_REENTRANT_GUARD(dequeuing);
+
+        size_t offset;
+        std::uint64_t length;
+        if (!front_record(offset, length)) return false;
+
+        std::atomic_thread_fence(std::memory_order_release);
+        block->store_front((offset + record_size(length)) & block->get_size_mask());
+        return true;
+    }
 
 }
 
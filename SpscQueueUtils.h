@@ -6,80 +6,385 @@
 #define SPSCQUEUEUTILS_H
 
 #include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <stdexcept>
+#include <cstdlib>
+#include <type_traits>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include <mutex>
+#include <unordered_map>
+#include <algorithm>
+#include <sched.h>
+#include <linux/futex.h>
+#include <linux/mempolicy.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// 调试检查（重入检测等）默认跟随 NDEBUG，也可以在编译选项中显式指定
+#ifndef SQ_DEBUG_CHECKS
+#ifdef NDEBUG
+#define SQ_DEBUG_CHECKS 0
+#else
+#define SQ_DEBUG_CHECKS 1
+#endif
+#endif
+
+// 热路径统计计数器，默认关闭；关闭时计数器和所有记录语句都不参与编译
+#ifndef SQ_ENABLE_STATS
+#define SQ_ENABLE_STATS 0
+#endif
 
 namespace sq
 {
 
     constexpr size_t CACHE_LINE_SIZE = 64;
 
+    // 内存序策略：Block 与 ReaderWriterQueue 的所有原子读写都从这里取内存序。
+    // 发布点前后已有显式的 acquire/release fence，访问器只需满足 acquire/release 协议；
+    // seq_cst 的 store 在 x86 上会生成 xchg，只在调试构建中作为默认值保留
+    struct AcquireReleaseOrdering
+    {
+        static constexpr std::memory_order load_order = std::memory_order_acquire;
+        static constexpr std::memory_order store_order = std::memory_order_release;
+    };
+
+    struct SeqCstOrdering
+    {
+        static constexpr std::memory_order load_order = std::memory_order_seq_cst;
+        static constexpr std::memory_order store_order = std::memory_order_seq_cst;
+    };
+
+#if SQ_DEBUG_CHECKS
+    using DefaultOrdering = SeqCstOrdering;
+#else
+    using DefaultOrdering = AcquireReleaseOrdering;
+#endif
+
+    // 自旋等待时让出流水线资源，减少对同核超线程的干扰
+    inline void cpu_relax()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        _mm_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield" ::: "memory");
+#else
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+#endif
+    }
+
+    // 块分配器：allocate 失败返回 nullptr，deallocate 收到的 size 与 allocate 时相同。
+    // 分配器对象保存在队列中，只会在生产者线程和队列析构时被使用
+    struct MallocBlockAllocator
+    {
+        void* allocate(std::size_t size) {return std::malloc(size);}
+        void deallocate(void* ptr, std::size_t) {std::free(ptr);}
+    };
+
+    // 以 2MB 大页承载块：优先使用显式大页（MAP_HUGETLB，需要预先在 hugetlbfs 中预留），
+    // 没有可用的显式大页时，退回到按 2MB 对齐的匿名映射并用 madvise(MADV_HUGEPAGE) 申请透明大页。
+    // 不超过半个大页的块从共享的 2MB 区域中按缓存行对齐顺序切出，释放的块按大小挂在空闲链表上复用，
+    // 许多小块共用一个大页的 TLB 表项；更大的块单独映射，长度向上取整到 2MB。
+    // 分配器的副本共享同一组区域（例如 FanInQueue 的各条通道），区域只在最后一个副本析构时归还，
+    // 区域状态由互斥量保护，只在分配和释放块（扩容、收缩）时加锁
+    class HugePageBlockAllocator
+    {
+        public:
+            static constexpr std::size_t HUGE_PAGE_SIZE = 2UL * 1024 * 1024;
+
+            HugePageBlockAllocator() : arenas(std::make_shared<ArenaPool>()) {}
+
+            void* allocate(std::size_t size)
+            {
+                if (size > HUGE_PAGE_SIZE / 2) return map_huge(round_up(size));
+                return arenas->allocate(round_to_line(size));
+            }
+
+            void deallocate(void* ptr, std::size_t size)
+            {
+                if (size > HUGE_PAGE_SIZE / 2) munmap(ptr, round_up(size));
+                else arenas->deallocate(ptr, round_to_line(size));
+            }
+
+            // 已经映射的共享区域数
+            [[nodiscard]] std::size_t arena_count() const
+            {
+                std::lock_guard<std::mutex> lock(arenas->mtx);
+                return arenas->regions.size();
+            }
+
+        private:
+            struct ArenaPool
+            {
+                ~ArenaPool()
+                {
+                    for (void* region : regions) munmap(region, HUGE_PAGE_SIZE);
+                }
+
+                void* allocate(std::size_t size)
+                {
+                    std::lock_guard<std::mutex> lock(mtx);
+                    try {
+                        void*& head = freeLists.try_emplace(size, nullptr).first->second;
+                        if (head != nullptr) {
+                            void* ptr = head;
+                            head = *static_cast<void**>(ptr);
+                            return ptr;
+                        }
+
+                        if (static_cast<std::size_t>(end - cursor) < size) {
+                            regions.reserve(regions.size() + 1);
+                            void* region = map_huge(HUGE_PAGE_SIZE);
+                            if (region == nullptr) return nullptr;
+                            regions.push_back(region);
+                            cursor = static_cast<char*>(region);
+                            end = cursor + HUGE_PAGE_SIZE;
+                        }
+                    } catch (const std::bad_alloc&) {
+                        return nullptr;
+                    }
+
+                    void* ptr = cursor;
+                    cursor += size;
+                    return ptr;
+                }
+
+                // 空闲链表的指针存放在释放的块内部；这个大小的表项在 allocate 时已经建好，这里不会分配内存
+                void deallocate(void* ptr, std::size_t size)
+                {
+                    std::lock_guard<std::mutex> lock(mtx);
+                    void*& head = freeLists.find(size)->second;
+                    *static_cast<void**>(ptr) = head;
+                    head = ptr;
+                }
+
+                std::mutex mtx;
+                std::vector<void*> regions;
+                std::unordered_map<std::size_t, void*> freeLists;  // 块大小 -> 空闲链表头
+                char* cursor{nullptr};  // 当前区域中下一个可切分的位置
+                char* end{nullptr};
+            };
+
+            static void* map_huge(std::size_t length)
+            {
+                void* ptr = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+                if (ptr != MAP_FAILED) return ptr;
+
+                // 多映射一个大页，裁掉首尾得到 2MB 对齐的区间，透明大页才能整页映射
+                std::size_t mapped = length + HUGE_PAGE_SIZE;
+                auto raw = static_cast<char*>(mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+                if (raw == MAP_FAILED) return nullptr;
+
+                auto aligned = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(raw) + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1));
+                if (aligned != raw) munmap(raw, aligned - raw);
+                if (aligned + length != raw + mapped) munmap(aligned + length, raw + mapped - (aligned + length));
+
+                madvise(aligned, length, MADV_HUGEPAGE);
+                return aligned;
+            }
+
+            static std::size_t round_up(std::size_t size) {return (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);}
+            static std::size_t round_to_line(std::size_t size) {return (size + CACHE_LINE_SIZE - 1) & ~(CACHE_LINE_SIZE - 1);}
+
+            std::shared_ptr<ArenaPool> arenas;
+    };
+
+    // 把块内存绑定到指定的 NUMA 节点（通常是消费者线程所在的节点）：先映射匿名内存，
+    // 再用 mbind 设置 MPOL_BIND 策略，之后首次写入触发的缺页都从该节点分配。
+    // 内核不支持 NUMA 时 mbind 失败，内存按默认策略分配，队列照常工作
+    class NumaBlockAllocator
+    {
+        public:
+            explicit NumaBlockAllocator(int _node = current_node()) : node(_node) {}
+
+            // 调用线程当前所在的 NUMA 节点，在消费者线程上调用即可得到消费者的节点
+            static int current_node()
+            {
+                unsigned cpu = 0, numaNode = 0;
+                if (syscall(SYS_getcpu, &cpu, &numaNode, nullptr) != 0) return 0;
+                return static_cast<int>(numaNode);
+            }
+
+            void* allocate(std::size_t size)
+            {
+                std::size_t length = round_up(size);
+                void* ptr = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if (ptr == MAP_FAILED) return nullptr;
+
+                constexpr std::size_t BITS = sizeof(unsigned long) * 8;
+                unsigned long nodemask[MAX_NODES / BITS]{};
+                if (node >= 0 && static_cast<std::size_t>(node) < MAX_NODES) {
+                    nodemask[node / BITS] = 1UL << (node % BITS);
+                    syscall(SYS_mbind, ptr, length, MPOL_BIND, nodemask, MAX_NODES + 1, 0);
+                }
+                return ptr;
+            }
+
+            void deallocate(void* ptr, std::size_t size) {munmap(ptr, round_up(size));}
+
+            [[nodiscard]] int get_node() const {return node;}
+
+        private:
+            static constexpr std::size_t MAX_NODES = 1024;
+
+            static std::size_t round_up(std::size_t size)
+            {
+                static const std::size_t pageSize = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+                return (size + pageSize - 1) & ~(pageSize - 1);
+            }
+
+            int node;
+    };
+
+    // 预热适配器：包装任意块分配器，拿到内存后立即写触每一页，让缺页发生在分配时而不是生产者第一次写入时。
+    // 构造函数预分配的块、reserve_capacity 链接的块和运行中扩容的块都经过这里
+    template<typename Allocator = MallocBlockAllocator>
+    struct PrefaultAllocator
+    {
+        PrefaultAllocator() = default;
+        explicit PrefaultAllocator(const Allocator& _inner) : inner(_inner) {}
+
+        void* allocate(std::size_t size)
+        {
+            void* ptr = inner.allocate(size);
+            if (ptr == nullptr) return nullptr;
+
+            // 只读访问只会映射到共享的零页，必须写入才能分配物理页
+            static const std::size_t pageSize = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+            auto bytes = static_cast<volatile char*>(ptr);
+            for (std::size_t offset = 0; offset < size; offset += pageSize) bytes[offset] = 0;
+            bytes[size - 1] = 0;
+            return ptr;
+        }
+
+        void deallocate(void* ptr, std::size_t size) {inner.deallocate(ptr, size);}
+
+        Allocator inner;
+    };
+
+    // 平凡析构的元素不需要逐个调用析构函数
     template<typename T>
+    inline void destroy_element(T* element)
+    {
+        if constexpr (!std::is_trivially_destructible_v<T>) element->~T();
+    }
+
+    // It 是否指向连续存放的 T（指针或 std::vector<T> 的迭代器），批量接口据此改用 memcpy
+    template<typename It, typename T>
+    constexpr bool is_contiguous_iterator_of_v =
+        (std::is_pointer_v<It> && std::is_same_v<std::remove_cv_t<std::remove_pointer_t<It>>, T>) ||
+        (!std::is_same_v<T, bool> && (std::is_same_v<It, typename std::vector<T>::iterator> ||
+                                      std::is_same_v<It, typename std::vector<T>::const_iterator>));
+
+    template<typename T, typename Ordering = DefaultOrdering>
     class alignas(CACHE_LINE_SIZE) Block
     {
         public:
-            Block(const std::size_t &_size, char* _raw_this, char* _data)
-                :data(_data), size_mask(_size-1), raw_this(_raw_this)
+            Block(const std::size_t &_size, char* _raw_this, std::size_t _raw_size, char* _data)
+                :data(_data), size_mask(_size-1), raw_this(_raw_this), raw_size(_raw_size)
             {}
 
+            // 可以整块 memcpy、无需析构的元素类型
+            static constexpr bool trivial_element = std::is_trivially_copyable_v<T> && std::is_trivially_destructible_v<T>;
+
             ~Block()
             {
-                // 队列为空是front == tail;
-                size_t block_front = front.load();
-                size_t block_tail = tail.load();
-                for(size_t i = block_front; i!=block_tail; i = (i+1) & size_mask)
+                if constexpr (!std::is_trivially_destructible_v<T>)
                 {
-                    auto elememt = get_element_at_idx(i);
-                    elememt->~T();
+                    // 队列为空是front == tail;
+                    size_t block_front = front.load(Ordering::load_order);
+                    size_t block_tail = tail.load(Ordering::load_order);
+                    for(size_t i = block_front; i!=block_tail; i = (i+1) & size_mask)
+                    {
+                        auto elememt = get_element_at_idx(i);
+                        elememt->~T();
+                    }
                 }
-                std::free(raw_this);
             }
 
-            // 为块本身及其包含的所有元素分配足够的内存
-            static Block* make_block(std::size_t capacity)
+            // 为块本身及其包含的所有元素分配足够的内存，内存来自 allocator
+            template<typename Allocator>
+            static Block* make_block(std::size_t capacity, Allocator& allocator)
             {
                 // 为块本身及其包含的所有元素分配足够的内存
                 // 确保 Block 类型的内存地址对齐到正确的字节边界。
                 auto size = sizeof(Block) + std::alignment_of_v<Block> - 1;
                 size += sizeof(T) * capacity + std::alignment_of_v<T> - 1;
 
-                auto newBlockRaw = static_cast<char*>(std::malloc(size));
+                auto newBlockRaw = static_cast<char*>(allocator.allocate(size));
                 if(!newBlockRaw) throw std::bad_alloc();
 
                 auto newBlockAligned = align_for<Block>(newBlockRaw);
                 auto newBlockData = align_for<T>(newBlockAligned + sizeof(Block));
-                return new (newBlockAligned) Block(capacity, newBlockRaw, newBlockData);
+                return new (newBlockAligned) Block(capacity, newBlockRaw, size, newBlockData);
+            }
+
+            // 析构块中剩余的元素，并把整块内存还给分配它的 allocator
+            template<typename Allocator>
+            static void destroy_block(Block* block, Allocator& allocator)
+            {
+                char* raw = block->raw_this;
+                std::size_t size = block->raw_size;
+                block->~Block();
+                allocator.deallocate(raw, size);
             }
 
             [[nodiscard]] char* get_raw_this() const {return raw_this;}
             T* get_element_at_idx(size_t idx) const {return reinterpret_cast<T*>(data + idx * sizeof(T));}
 
-            template<typename U>
-            void construct_element_at_idx(size_t idx, U&& t)
+            template<typename... Args>
+            void construct_element_at_idx(size_t idx, Args&&... args)
             {
                 char *pos = data + idx * sizeof(T);
-                new (pos) T(std::forward<U>(t));
+                new (pos) T(std::forward<Args>(args)...);
+            }
+            // 以下两个只用于 trivial_element：从 idx 开始复制 count 个元素，在块尾回绕，最多两段 memcpy
+            void copy_in(size_t idx, const T* src, size_t count)
+            {
+                size_t first = std::min(count, size_mask + 1 - idx);
+                std::memcpy(static_cast<void*>(get_element_at_idx(idx)), src, first * sizeof(T));
+                std::memcpy(static_cast<void*>(get_element_at_idx(0)), src + first, (count - first) * sizeof(T));
             }
-            [[nodiscard]] size_t get_front() const {return front.load();}
-            [[nodiscard]] size_t get_tail() const {return tail.load();}
+
+            void copy_out(size_t idx, T* dest, size_t count) const
+            {
+                size_t first = std::min(count, size_mask + 1 - idx);
+                std::memcpy(static_cast<void*>(dest), get_element_at_idx(idx), first * sizeof(T));
+                std::memcpy(static_cast<void*>(dest + first), get_element_at_idx(0), (count - first) * sizeof(T));
+            }
+
+            [[nodiscard]] size_t get_front() const {return front.load(Ordering::load_order);}
+            [[nodiscard]] size_t get_tail() const {return tail.load(Ordering::load_order);}
             [[nodiscard]] size_t get_local_front() const {return local_front;}
             [[nodiscard]] size_t get_local_tail() const {return local_tail;}
             [[nodiscard]] size_t get_local_front_from_front()
             {
-                local_front = front.load();
+                local_front = front.load(Ordering::load_order);
                 return local_front;
             }
             [[nodiscard]] size_t get_local_tail_from_tail()
             {
-                local_tail = tail.load();
+                local_tail = tail.load(Ordering::load_order);
                 return local_tail;
             }
 
-            void store_front(size_t t) {front.store(t);}
-            void store_tail(size_t t) {tail.store(t);}
-            void store_next(Block * t){next.store(t);}
+            void store_front(size_t t) {front.store(t, Ordering::store_order);}
+            void store_tail(size_t t) {tail.store(t, Ordering::store_order);}
+            void store_next(Block * t){next.store(t, Ordering::store_order);}
 
             [[nodiscard]] size_t forward(size_t i) const {return (i + 1) & size_mask;}
+            [[nodiscard]] size_t get_size_mask() const {return size_mask;}  // 块内可用槽位数，容量为 size_mask + 1
 
-            Block* next_block() {return next.load();}
+            Block* next_block() const {return next.load(Ordering::load_order);}
 
         private:
             template <typename U>
@@ -109,21 +414,324 @@ namespace sq
             const std::size_t size_mask;
 
             char* raw_this;
+            std::size_t raw_size;
 
     };
 
+#if SQ_DEBUG_CHECKS
+    // 检测在元素的构造/析构中重入同一侧的队列操作；发布构建中整个守卫连同标志位一起被去掉
     struct ReentrantGuard
     {
         explicit ReentrantGuard(std::atomic<bool>& _inSection)
         : inSection(_inSection)
         {
-            inSection=true;
+            if (inSection.exchange(true, std::memory_order_relaxed))
+                throw std::runtime_error("ReaderWriterQueue does not support re-entrant enqueue/dequeue from element constructors or destructors");
         }
-        ~ReentrantGuard() {inSection=false;}
+        ~ReentrantGuard() {inSection.store(false, std::memory_order_relaxed);}
         ReentrantGuard& operator=(const ReentrantGuard&) = delete;
     private:
         std::atomic<bool> &inSection;
     };
+#define SQ_REENTRANT_GUARD(flag) ReentrantGuard reentrantGuard(this->flag)
+#else
+#define SQ_REENTRANT_GUARD(flag) ((void)0)
+#endif
+
+#if SQ_ENABLE_STATS
+    // 队列统计的一份快照。生产者一侧与消费者一侧各自一致，先读消费者一侧，所以 dequeued 不会超过 enqueued
+    struct QueueStats
+    {
+        std::size_t enqueued;  // 已入队（构造）的元素数
+        std::size_t dequeued;  // 已出队的元素数
+        std::size_t blocksAllocated;  // make_block 的调用次数
+        std::size_t tailBlockFull;  // 生产者发现尾部块已满的次数
+        std::size_t blockHops;  // 消费者前进到下一个块的次数
+        std::size_t highWaterMark;  // 元素数量的历史最大值
+        std::size_t capacity;  // 当前所有块的槽位总数
+    };
+
+    // 单写者计数器组：只由拥有它的线程修改（普通的 load + store，没有 RMW），独占缓存行。
+    // 修改包在 begin_write/end_write 之间，任意线程都可以通过 snapshot 读到一组一致的值（seqlock）
+    template<std::size_t N>
+    class alignas(CACHE_LINE_SIZE) StatCounters
+    {
+        public:
+            void begin_write()
+            {
+                seq.store(seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_release);
+            }
+
+            void end_write() {seq.store(seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);}
+
+            // 以下三个只能由拥有者调用（get 也可以由另一侧读取单个计数的近似值）
+            [[nodiscard]] std::size_t get(std::size_t idx) const {return values[idx].load(std::memory_order_relaxed);}
+            void set(std::size_t idx, std::size_t value) {values[idx].store(value, std::memory_order_relaxed);}
+            void add(std::size_t idx, std::size_t delta = 1) {set(idx, get(idx) + delta);}
+
+            void snapshot(std::size_t (&out)[N]) const
+            {
+                while (true) {
+                    unsigned before = seq.load(std::memory_order_acquire);
+                    for (std::size_t i = 0; i != N; ++i) out[i] = values[i].load(std::memory_order_relaxed);
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                    if ((before & 1) == 0 && seq.load(std::memory_order_relaxed) == before) return;
+                    cpu_relax();
+                }
+            }
+
+        private:
+            std::atomic<unsigned> seq{0};  // 奇数表示写入进行中
+            std::atomic<std::size_t> values[N]{};
+    };
+#define SQ_STATS(stmt) stmt
+#else
+#define SQ_STATS(stmt) ((void)0)
+#endif
+
+    namespace spsc_sema
+    {
+        static_assert(sizeof(std::atomic<int>) == sizeof(int), "futex 需要直接作用在 32 位整数上");
+
+        // 当 *addr == expected 时睡眠，timeout 为空表示无限等待
+        inline long futex_wait(std::atomic<int>& addr, int expected, const timespec* timeout)
+        {
+            return syscall(SYS_futex, reinterpret_cast<int*>(&addr), FUTEX_WAIT_PRIVATE, expected, timeout, nullptr, 0);
+        }
+
+        inline long futex_wake(std::atomic<int>& addr, int count)
+        {
+            return syscall(SYS_futex, reinterpret_cast<int*>(&addr), FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+        }
+
+        // 基于 futex 的内核信号量，只在确实有线程需要睡眠/唤醒时才被 LightweightSemaphore 使用
+        class Semaphore
+        {
+            public:
+                explicit Semaphore(int initialCount = 0) : count(initialCount) {}
+                Semaphore(const Semaphore&) = delete;
+                Semaphore& operator=(const Semaphore&) = delete;
+
+                bool try_wait()
+                {
+                    int old = count.load(std::memory_order_relaxed);
+                    while (old > 0) {
+                        if (count.compare_exchange_weak(old, old - 1, std::memory_order_acquire, std::memory_order_relaxed))
+                            return true;
+                    }
+                    return false;
+                }
+
+                bool wait()
+                {
+                    while (!try_wait()) {
+                        futex_wait(count, 0, nullptr);  // 计数仍为 0 才睡眠，否则立即返回重试
+                    }
+                    return true;
+                }
+
+                bool timed_wait(std::int64_t timeout_usecs)
+                {
+                    auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(timeout_usecs);
+                    while (!try_wait()) {
+                        auto remaining = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - std::chrono::steady_clock::now()).count();
+                        if (remaining <= 0) return false;
+
+                        timespec ts{};
+                        ts.tv_sec = static_cast<time_t>(remaining / 1000000000);
+                        ts.tv_nsec = static_cast<long>(remaining % 1000000000);
+                        futex_wait(count, 0, &ts);
+                    }
+                    return true;
+                }
+
+                void signal(int n = 1)
+                {
+                    count.fetch_add(n, std::memory_order_release);
+                    futex_wake(count, n);
+                }
+
+            private:
+                std::atomic<int> count;
+        };
+
+        // 用户态计数 + 内核信号量：计数为负表示有等待者。
+        // signal 在无人等待时只做一次 fetch_add，不进入内核；wait 先短暂自旋，失败后才在 futex 上睡眠
+        class LightweightSemaphore
+        {
+            public:
+                using ssize_t = std::make_signed_t<std::size_t>;
+
+                explicit LightweightSemaphore(ssize_t initialCount = 0) : count(initialCount)
+                {
+                    assert(initialCount >= 0);
+                }
+
+                bool tryWait()
+                {
+                    ssize_t old = count.load(std::memory_order_relaxed);
+                    while (old > 0) {
+                        if (count.compare_exchange_weak(old, old - 1, std::memory_order_acquire, std::memory_order_relaxed))
+                            return true;
+                    }
+                    return false;
+                }
+
+                bool wait() {return tryWait() || waitWithPartialSpinning(-1);}
+
+                // timeout_usecs < 0 表示无限等待
+                bool wait(std::int64_t timeout_usecs) {return tryWait() || waitWithPartialSpinning(timeout_usecs);}
+
+                void signal(ssize_t n = 1)
+                {
+                    assert(n >= 0);
+                    ssize_t old = count.fetch_add(n, std::memory_order_release);
+                    ssize_t toRelease = -old < n ? -old : n;
+                    if (toRelease > 0) sema.signal(static_cast<int>(toRelease));
+                }
+
+                [[nodiscard]] std::size_t availableApprox() const
+                {
+                    ssize_t c = count.load(std::memory_order_relaxed);
+                    return c > 0 ? static_cast<std::size_t>(c) : 0;
+                }
+
+            private:
+                static constexpr int SPIN_COUNT = 1024;
+
+                bool waitWithPartialSpinning(std::int64_t timeout_usecs)
+                {
+                    for (int spin = 0; spin != SPIN_COUNT; ++spin) {
+                        if (tryWait()) return true;
+                        cpu_relax();
+                    }
+
+                    ssize_t old = count.fetch_sub(1, std::memory_order_acquire);
+                    if (old > 0) return true;
+
+                    if (timeout_usecs < 0) return sema.wait();
+                    if (timeout_usecs > 0 && sema.timed_wait(timeout_usecs)) return true;
+
+                    // 超时：撤销先前的 fetch_sub。若期间有 signal 把计数加回来，就必须把对应的内核信号量消耗掉
+                    while (true) {
+                        old = count.load(std::memory_order_acquire);
+                        if (old >= 0 && sema.try_wait()) return true;
+                        if (old < 0 && count.compare_exchange_strong(old, old + 1, std::memory_order_relaxed, std::memory_order_relaxed))
+                            return false;
+                    }
+                }
+
+                std::atomic<ssize_t> count;
+                Semaphore sema;
+        };
+    }
+
+    // 消费者等待策略：wait(ready) 反复调用 ready() 直到它返回 true，两次尝试之间按各自的方式让出 CPU。
+    // 生产者在发布元素后调用 notify()，只有会睡眠的策略需要它，其余策略是空操作，所以生产者代码可以不关心具体策略
+    struct BusySpinWait
+    {
+        template<typename Ready>
+        void wait(Ready&& ready) {while (!ready()) cpu_relax();}
+
+        void notify() {}
+    };
+
+    // 先自旋 spinLimit 次，之后每次尝试前 sched_yield
+    struct SpinYieldWait
+    {
+        explicit SpinYieldWait(unsigned limit = 4096) : spinLimit(limit) {}
+
+        template<typename Ready>
+        void wait(Ready&& ready)
+        {
+            for (unsigned spins = 0; !ready(); ++spins) {
+                if (spins < spinLimit) cpu_relax();
+                else sched_yield();
+            }
+        }
+
+        void notify() {}
+
+        unsigned spinLimit;
+    };
+
+    // 指数退避：每次失败后 pause 次数翻倍，达到 maxPauses 后改为睡眠，睡眠时间同样翻倍直到 maxSleep
+    struct BackoffWait
+    {
+        explicit BackoffWait(unsigned pauses = 1024, std::chrono::microseconds sleep = std::chrono::microseconds(1000))
+        : maxPauses(pauses), maxSleep(sleep)
+        {}
+
+        template<typename Ready>
+        void wait(Ready&& ready)
+        {
+            unsigned pauses = 1;
+            std::chrono::microseconds sleep(1);
+            while (!ready()) {
+                if (pauses <= maxPauses) {
+                    for (unsigned i = 0; i != pauses; ++i) cpu_relax();
+                    pauses <<= 1;
+                } else {
+                    timespec ts = to_timespec(sleep);
+                    nanosleep(&ts, nullptr);
+                    if (sleep < maxSleep) sleep = std::min(sleep * 2, maxSleep);
+                }
+            }
+        }
+
+        void notify() {}
+
+        // tv_nsec 必须小于 1e9，否则 nanosleep 返回 EINVAL 立刻回来，maxSleep >= 1s 时会退化成忙等
+        static timespec to_timespec(std::chrono::microseconds duration)
+        {
+            auto seconds = std::chrono::duration_cast<std::chrono::seconds>(duration);
+            auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(duration - seconds);
+            return timespec{static_cast<time_t>(seconds.count()), static_cast<long>(nanos.count())};
+        }
+
+        unsigned maxPauses;
+        std::chrono::microseconds maxSleep;
+    };
+
+    // 先自旋，再在 futex 上睡眠。消费者先写 parked 再复查，生产者先发布再读 parked，两边各用一个 seq_cst 栅栏，
+    // 保证"消费者睡眠"与"生产者看到没人睡眠"不会同时发生。需要生产者在每次发布后调用 notify
+    class alignas(CACHE_LINE_SIZE) SpinParkWait
+    {
+        public:
+            explicit SpinParkWait(unsigned limit = 1024) : spinLimit(limit) {}
+
+            template<typename Ready>
+            void wait(Ready&& ready)
+            {
+                for (unsigned spins = 0; spins != spinLimit; ++spins) {
+                    if (ready()) return;
+                    cpu_relax();
+                }
+
+                while (true) {
+                    parked.store(1, std::memory_order_relaxed);
+                    std::atomic_thread_fence(std::memory_order_seq_cst);
+                    if (ready()) break;
+                    spsc_sema::futex_wait(parked, 1, nullptr);  // notify 已经清零则立即返回
+                    if (ready()) break;
+                }
+                parked.store(0, std::memory_order_relaxed);
+            }
+
+            void notify()
+            {
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (parked.load(std::memory_order_relaxed) != 0) {
+                    parked.store(0, std::memory_order_relaxed);
+                    spsc_sema::futex_wake(parked, 1);
+                }
+            }
+
+        private:
+            std::atomic<int> parked{0};  // futex 字，独占缓存行，消费者睡眠前置 1
+            unsigned spinLimit;
+    };
 
 }
 
@@ -0,0 +1,192 @@
+//
+// SPSC 队列基准测试，结果以 CSV 输出到 stdout：scenario,queue,payload_bytes,items,metric,value
+// 用法：bench_sq [items] [round_trips]
+//
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include "SpscQueue.h"
+
+using Clock = std::chrono::steady_clock;
+
+template<size_t Bytes>
+struct Payload {
+    std::uint64_t seq;
+    char pad[Bytes - sizeof(std::uint64_t)];
+
+    Payload() = default;
+    explicit Payload(std::uint64_t s) : seq(s) {}
+};
+
+inline std::uint64_t sequence_of(int value) {return static_cast<std::uint64_t>(value);}
+
+template<size_t Bytes>
+inline std::uint64_t sequence_of(const Payload<Bytes>& value) {return value.seq;}
+
+// 先自旋，再让出 CPU：核数少于 2 时对端线程也能得到调度
+inline void backoff(int& spins) {
+    if (++spins < 4096) {
+        sq::cpu_relax();
+    } else {
+        std::this_thread::yield();
+    }
+}
+
+void report(const char* scenario, const char* queue, size_t payload, size_t items, const char* metric, double value) {
+    std::cout << scenario << ',' << queue << ',' << payload << ',' << items << ',' << metric << ',' << value << '\n';
+}
+
+// 持续吞吐：生产者与消费者各占一个线程，从第一次入队到最后一次出队计时
+template<typename Queue, typename T>
+void bench_throughput(const char* name, Queue& queue, size_t items) {
+    Clock::time_point start = Clock::now();
+
+    std::thread producer_thread([&queue, items]() {
+        for (size_t i = 0; i < items; ++i) {
+            int spins = 0;
+            while (!queue.try_enqueue(T(i))) backoff(spins);
+        }
+    });
+
+    T value;
+    for (size_t i = 0; i < items; ++i) {
+        int spins = 0;
+        while (!queue.try_dequeue(value)) backoff(spins);
+        if (sequence_of(value) != i) {
+            std::cerr << "order mismatch in " << name << std::endl;
+            std::abort();
+        }
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    producer_thread.join();
+
+    report("throughput", name, sizeof(T), items, "ops_per_sec", static_cast<double>(items) / seconds);
+}
+
+// 批量吞吐：生产者每次 enqueue_bulk 一批，消费者每次 try_dequeue_bulk 最多一批
+template<typename T>
+void bench_bulk_throughput(size_t items, size_t batch) {
+    sq::ReaderWriterQueue<T> queue(8192);
+    Clock::time_point start = Clock::now();
+
+    std::thread producer_thread([&queue, items, batch]() {
+        std::vector<T> burst(batch);
+        for (size_t i = 0; i < items; i += batch) {
+            size_t n = std::min(batch, items - i);
+            for (size_t k = 0; k < n; ++k) burst[k] = T(i + k);
+            int spins = 0;
+            while (!queue.try_enqueue_bulk(burst.begin(), n)) backoff(spins);
+        }
+    });
+
+    std::vector<T> out(batch);
+    for (size_t received = 0; received < items;) {
+        int spins = 0;
+        size_t n;
+        while ((n = queue.try_dequeue_bulk(out.begin(), batch)) == 0) backoff(spins);
+        if (sequence_of(out[0]) != received) {
+            std::cerr << "order mismatch in bulk throughput" << std::endl;
+            std::abort();
+        }
+        received += n;
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    producer_thread.join();
+
+    report("bulk_throughput", "ReaderWriterQueue", sizeof(T), items, "ops_per_sec", static_cast<double>(items) / seconds);
+}
+
+// 跨线程 ping-pong：逐次记录往返时间并给出分位数
+template<typename Queue>
+void bench_ping_pong(const char* name, size_t round_trips) {
+    Queue ping(64), pong(64);
+
+    std::thread echo_thread([&ping, &pong, round_trips]() {
+        int value;
+        for (size_t i = 0; i < round_trips; ++i) {
+            int spins = 0;
+            while (!ping.try_dequeue(value)) backoff(spins);
+            pong.try_enqueue(value);
+        }
+    });
+
+    std::vector<double> samples(round_trips);
+    int value;
+    for (size_t i = 0; i < round_trips; ++i) {
+        Clock::time_point start = Clock::now();
+        ping.try_enqueue(static_cast<int>(i));
+        int spins = 0;
+        while (!pong.try_dequeue(value)) backoff(spins);
+        samples[i] = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    }
+    echo_thread.join();
+
+    std::sort(samples.begin(), samples.end());
+    auto percentile = [&samples](double p) {return samples[std::min(samples.size() - 1, static_cast<size_t>(p * samples.size()))];};
+    report("ping_pong", name, sizeof(int), round_trips, "rtt_p50_ns", percentile(0.50));
+    report("ping_pong", name, sizeof(int), round_trips, "rtt_p99_ns", percentile(0.99));
+    report("ping_pong", name, sizeof(int), round_trips, "rtt_p999_ns", percentile(0.999));
+}
+
+// 扩容：从只有一个最小块的队列开始，生产者一直 enqueue（允许分配），覆盖块分配与链接路径
+template<typename T>
+void bench_growth(size_t items) {
+    sq::ReaderWriterQueue<T> queue(1);
+    Clock::time_point start = Clock::now();
+
+    std::thread producer_thread([&queue, items]() {
+        for (size_t i = 0; i < items; ++i) {
+            if (!queue.enqueue(T(i))) std::abort();
+        }
+    });
+
+    T value;
+    for (size_t i = 0; i < items; ++i) {
+        int spins = 0;
+        while (!queue.try_dequeue(value)) backoff(spins);
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    producer_thread.join();
+
+    report("growth", "ReaderWriterQueue", sizeof(T), items, "ops_per_sec", static_cast<double>(items) / seconds);
+    report("growth", "ReaderWriterQueue", sizeof(T), items, "final_capacity", static_cast<double>(queue.max_capacity()));
+}
+
+template<typename T>
+void bench_payload(size_t items) {
+    {
+        sq::ReaderWriterQueue<T> queue(8192);
+        bench_throughput<sq::ReaderWriterQueue<T>, T>("ReaderWriterQueue", queue, items);
+    }
+    {
+        auto ring = std::make_unique<sq::FixedRing<T, 8192>>();
+        bench_throughput<sq::FixedRing<T, 8192>, T>("FixedRing", *ring, items);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    size_t items = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10000000;
+    size_t round_trips = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 100000;
+
+    std::cout << "scenario,queue,payload_bytes,items,metric,value\n";
+
+    bench_payload<int>(items);
+    bench_payload<Payload<64>>(items);
+    bench_payload<Payload<256>>(items);
+
+    bench_bulk_throughput<int>(items, 256);
+    bench_bulk_throughput<Payload<64>>(items, 256);
+
+    bench_ping_pong<sq::ReaderWriterQueue<int>>("ReaderWriterQueue", round_trips);
+    bench_ping_pong<sq::FixedRing<int, 64>>("FixedRing", round_trips);
+
+    bench_growth<int>(items);
+    bench_growth<Payload<256>>(items);
+
+    return 0;
+}
@@ -0,0 +1,343 @@
+//
+// 队列测试：单线程与多线程性能，以及多生产者多消费者下每个元素恰好出队一次
+//
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <chrono>  // 用于计时
+#include <cstdlib>
+#include <algorithm>
+#include <string>
+#include <stdexcept>
+#include "Queue.h"
+
+// 单线程测试性能
+template<typename QueueType>
+void test_single_thread_performance()
+{
+    QueueType queue{};
+    int num_operations = 1000000;  // 测试操作的数量
+
+    // 计时：push 操作
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < num_operations; ++i) {
+        queue.push(i);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+    std::cout << "Single-thread push: " << duration << " ms" << std::endl;
+
+    // 计时：pop 操作，顺序必须与 push 相同
+    start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < num_operations; ++i) {
+        auto res = queue.pop();
+        if (!res || *res != i) {
+            std::cout << "Single-thread order mismatch at " << i << std::endl;
+            std::abort();
+        }
+    }
+    end = std::chrono::high_resolution_clock::now();
+    duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+    std::cout << "Single-thread pop: " << duration << " ms" << std::endl;
+
+    if (queue.pop()) {
+        std::cout << "Queue should be empty" << std::endl;
+        std::abort();
+    }
+}
+
+// 有界队列满了返回 false，其他队列的 push 总能成功
+template<typename QueueType>
+bool try_push(QueueType& queue, int value)
+{
+    queue.push(value);
+    return true;
+}
+
+template<typename T>
+bool try_push(LockFreeQueue3<T>& queue, int value)
+{
+    return queue.push(value);
+}
+
+template<typename QueueType>
+bool try_pop(QueueType& queue, int& value)
+{
+    auto res = queue.pop();
+    if (!res) return false;
+    value = *res;
+    return true;
+}
+
+template<typename T>
+bool try_pop(LockFreeQueue3<T>& queue, int& value)
+{
+    return queue.pop(value);
+}
+
+// 有界队列：填满后 push 失败，取空后 pop 失败，多绕几圈检查序号交接
+void test_bounded_capacity()
+{
+    LockFreeQueue3<int> queue(1000);
+    if (queue.capacity() != 1024) {
+        std::cout << "Capacity should round up to 1024" << std::endl;
+        std::abort();
+    }
+
+    int value;
+    for (int round = 0; round < 3; ++round) {
+        for (int i = 0; i < 1024; ++i) {
+            if (!queue.push(i)) {
+                std::cout << "Bounded push failed at " << i << std::endl;
+                std::abort();
+            }
+        }
+        if (queue.push(-1)) {
+            std::cout << "Bounded push should fail when full" << std::endl;
+            std::abort();
+        }
+        for (int i = 0; i < 1024; ++i) {
+            if (!queue.pop(value) || value != i) {
+                std::cout << "Bounded order mismatch at " << i << std::endl;
+                std::abort();
+            }
+        }
+        if (queue.pop(value)) {
+            std::cout << "Bounded pop should fail when empty" << std::endl;
+            std::abort();
+        }
+    }
+    std::cout << "Bounded capacity passed" << std::endl;
+}
+
+// 阻塞出队：消费者先等待，生产者随后入队并唤醒
+void test_wait_pop()
+{
+    Queue<std::string> queue;
+    const int items = 10000;
+    std::thread consumer([&queue, items]() {
+        for (int i = 0; i < items; ++i) {
+            std::string value = i % 2 ? queue.wait_pop() : std::string();
+            if (i % 2 == 0) queue.wait_pop(value);
+            if (value != std::to_string(i)) {
+                std::cout << "wait_pop order mismatch at " << i << std::endl;
+                std::abort();
+            }
+        }
+    });
+    for (int i = 0; i < items; ++i) {
+        queue.push(std::to_string(i));
+    }
+    consumer.join();
+    std::cout << "Queue wait_pop passed" << std::endl;
+}
+
+// 多个消费者阻塞在 wait_pop 上，生产者用 push_bulk 成批入队，一批唤醒多个等待者
+void test_bulk_wake(int num_consumers)
+{
+    Queue<int> queue;
+    const int per_consumer = 20000;
+    const int total = per_consumer * num_consumers;
+    std::vector<std::atomic<int>> seen(total);
+
+    std::vector<std::thread> consumers;
+    for (int c = 0; c < num_consumers; ++c) {
+        consumers.emplace_back([&queue, &seen, per_consumer]() {
+            for (int i = 0; i < per_consumer; ++i) {
+                seen[queue.wait_pop()].fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+    }
+
+    std::vector<int> batch;
+    for (int i = 0; i < total; i += num_consumers) {
+        batch.clear();
+        for (int k = 0; k < num_consumers; ++k) batch.push_back(i + k);
+        queue.push_bulk(batch.begin(), batch.end());
+    }
+    for (auto& t : consumers) {
+        t.join();
+    }
+
+    for (int i = 0; i < total; ++i) {
+        if (seen[i].load(std::memory_order_relaxed) != 1) {
+            std::cout << "Bulk wake lost value " << i << std::endl;
+            std::abort();
+        }
+    }
+    std::cout << "Queue push_bulk wake passed" << std::endl;
+}
+
+// 拷贝构造在值为 13 时抛出
+struct ThrowOnCopy
+{
+    int value;
+
+    explicit ThrowOnCopy(int v) : value(v) {}
+    ThrowOnCopy(const ThrowOnCopy& other) : value(other.value)
+    {
+        if (value == 13) throw std::runtime_error("copy of 13");
+    }
+    ThrowOnCopy(ThrowOnCopy&&) noexcept = default;
+    ThrowOnCopy& operator=(const ThrowOnCopy&) = default;
+    ThrowOnCopy& operator=(ThrowOnCopy&&) noexcept = default;
+};
+
+// 元素构造抛出：push 不改变队列，push_bulk 保留抛出点之前的元素，之后的入队出队照常进行
+void test_throwing_push()
+{
+    Queue<ThrowOnCopy> queue;
+    auto expect_throw = [](auto&& operation) {
+        try {
+            operation();
+        } catch (const std::runtime_error&) {
+            return;
+        }
+        std::cout << "Throwing copy should propagate" << std::endl;
+        std::abort();
+    };
+    auto expect_values = [&queue](int first, int last) {
+        for (int i = first; i < last; ++i) {
+            auto res = queue.pop();
+            if (!res || res->value != i) {
+                std::cout << "Throwing push order mismatch at " << i << std::endl;
+                std::abort();
+            }
+        }
+        if (queue.pop()) {
+            std::cout << "Throwing push left extra elements" << std::endl;
+            std::abort();
+        }
+    };
+
+    ThrowOnCopy fragile(13);
+    queue.push(ThrowOnCopy(0));
+    expect_throw([&] {queue.push(fragile);});
+    queue.push(ThrowOnCopy(1));
+    expect_values(0, 2);
+
+    std::vector<ThrowOnCopy> batch;
+    for (int i = 0; i < 20; ++i) batch.emplace_back(i);
+    expect_throw([&] {queue.push_bulk(batch.begin(), batch.end());});
+    expect_values(0, 13);
+
+    expect_throw([&] {queue.push_bulk(batch.begin() + 13, batch.end());});
+    queue.push_bulk(batch.begin(), batch.begin() + 5);
+    expect_values(0, 5);
+    std::cout << "Queue throwing push passed" << std::endl;
+}
+
+// 多生产者多消费者：生产者和消费者同时运行，每个值必须恰好被取出一次，且同一生产者的值按顺序出队
+template<typename QueueType>
+void test_multi_thread_performance(int num_producers, int num_consumers)
+{
+    QueueType queue{};
+    const int per_producer = 200000;
+    const int total = per_producer * num_producers;
+    std::vector<std::atomic<int>> seen(total);
+    std::atomic<int> popped{0};
+
+    auto push_fn = [&queue, per_producer](int producer) {
+        for (int i = 0; i < per_producer; ++i) {
+            int misses = 0;
+            while (!try_push(queue, producer * per_producer + i)) {
+                if (++misses > 64) std::this_thread::yield();
+            }
+        }
+    };
+
+    auto pop_fn = [&queue, &seen, &popped, total, per_producer, num_producers]() {
+        std::vector<int> last(num_producers, -1);
+        int misses = 0;
+        while (popped.load(std::memory_order_relaxed) < total) {
+            int value;
+            if (!try_pop(queue, value)) {
+                // 核数少时让出 CPU，生产者才能继续
+                if (++misses > 64) std::this_thread::yield();
+                continue;
+            }
+            misses = 0;
+            int producer = value / per_producer;
+            if (value % per_producer <= last[producer] || seen[value].fetch_add(1, std::memory_order_relaxed) != 0) {
+                std::cout << "Value " << value << " popped twice or out of order" << std::endl;
+                std::abort();
+            }
+            last[producer] = value % per_producer;
+            popped.fetch_add(1, std::memory_order_relaxed);
+        }
+    };
+
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<std::thread> threads;
+    threads.reserve(num_producers + num_consumers);
+    for (int i = 0; i < num_consumers; ++i) {
+        threads.emplace_back(pop_fn);
+    }
+    for (int i = 0; i < num_producers; ++i) {
+        threads.emplace_back(push_fn, i);
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+
+    for (int i = 0; i < total; ++i) {
+        if (seen[i].load(std::memory_order_relaxed) != 1) {
+            std::cout << "Value " << i << " was lost" << std::endl;
+            std::abort();
+        }
+    }
+    std::cout << num_producers << " producers / " << num_consumers << " consumers: " << duration << " ms, "
+              << static_cast<double>(total) / 1000.0 / static_cast<double>(std::max<long long>(duration, 1)) << " Mops/s" << std::endl;
+}
+
+// 扩展性：固定一个消费者增加生产者，再固定一个生产者增加消费者。
+// 入队和出队互不争用锁时，两组结果应当各自随线程数变化，而不是互相拖累
+template<typename QueueType>
+void test_scaling(int max_threads)
+{
+    for (int producers = 1; producers <= max_threads; producers *= 2) {
+        test_multi_thread_performance<QueueType>(producers, 1);
+    }
+    for (int consumers = 2; consumers <= max_threads; consumers *= 2) {
+        test_multi_thread_performance<QueueType>(1, consumers);
+    }
+}
+
+int main()
+{
+    // 测试 Queue 性能
+    std::cout << "Testing Queue performance..." << std::endl;
+    test_single_thread_performance<Queue<int>>();
+    test_wait_pop();
+    test_bulk_wake(4);
+    test_throwing_push();
+    test_multi_thread_performance<Queue<int>>(4, 4);
+    test_scaling<Queue<int>>(4);
+
+    // 测试 LockFreeQueue2 性能
+    std::cout << "Testing LockFreeQueue2 performance..." << std::endl;
+    LockFreeQueue2<int> probe;
+    std::cout << "LockFreeQueue2 is lock free: " << std::boolalpha << probe.is_lock_free() << std::endl;
+#if defined(__x86_64__) && defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_16)
+    // x86-64 上 CMake 给 test_queue 打开了 -mcx16，双字 CAS 必须是无锁的
+    if (!probe.is_lock_free()) {
+        std::cout << "LockFreeQueue2 should be lock free with -mcx16" << std::endl;
+        std::abort();
+    }
+#endif
+    test_single_thread_performance<LockFreeQueue2<int>>();
+    test_multi_thread_performance<LockFreeQueue2<int>>(1, 1);
+    test_multi_thread_performance<LockFreeQueue2<int>>(4, 4);
+
+    // 测试 LockFreeQueue3 性能
+    std::cout << "Testing LockFreeQueue3 performance..." << std::endl;
+    test_bounded_capacity();
+    test_multi_thread_performance<LockFreeQueue3<int>>(1, 1);
+    test_multi_thread_performance<LockFreeQueue3<int>>(4, 4);
+
+    return 0;
+}
@@ -4,7 +4,18 @@
 #include <iostream>
 #include <thread>
 #include <vector>
+#include <chrono>
+#include <string>
+#include <new>
+#include <memory>
+#include <atomic>
+#include <exception>
+#include <type_traits>
+#include <stdexcept>
 #include "SpscQueue.h"  // 你的SPSC队列头文件路径
+#include "MpscQueue.h"
+#include "ShmQueue.h"
+#include <sys/wait.h>
 
 void producer(sq::ReaderWriterQueue<int>& queue, int items_to_produce) {
     for (int i = 0; i < items_to_produce; ++i) {
@@ -23,6 +34,835 @@ void consumer(sq::ReaderWriterQueue<int>& queue, int items_to_consume) {
     }
 }
 
+// 调试构建下 DefaultOrdering 是 SeqCstOrdering，多线程测试再用 AcquireReleaseOrdering 各跑一遍，覆盖发布构建实际使用的协议
+template<typename Ordering>
+const char* ordering_name() {
+    return std::is_same<Ordering, sq::AcquireReleaseOrdering>::value ? "acq_rel" : "seq_cst";
+}
+
+// 批量接口：生产者按突发批次入队，消费者批量取出并检查顺序
+template<typename Ordering = sq::DefaultOrdering>
+void test_bulk(int items) {
+    sq::ReaderWriterQueue<int, 512, Ordering> queue(4);  // 从很小的容量开始，覆盖跨块与扩容路径
+
+    std::thread producer_thread([&queue, items]() {
+        std::vector<int> burst;
+        for (int i = 0; i < items; i += static_cast<int>(burst.size())) {
+            burst.clear();
+            for (int j = i; j < items && j < i + 1000; ++j) burst.push_back(j);
+            queue.enqueue_bulk(burst.begin(), burst.size());
+        }
+    });
+
+    std::thread consumer_thread([&queue, items]() {
+        std::vector<int> out(256);
+        int expected = 0;
+        while (expected < items) {
+            size_t n = queue.try_dequeue_bulk(out.begin(), out.size());
+            for (size_t k = 0; k < n; ++k, ++expected) {
+                if (out[k] != expected) {
+                    std::cout << "Bulk order mismatch: " << out[k] << " != " << expected << std::endl;
+                    std::abort();
+                }
+            }
+        }
+    });
+
+    producer_thread.join();
+    consumer_thread.join();
+    std::cout << "Bulk test passed (" << ordering_name<Ordering>() << "): " << items << " items" << std::endl;
+}
+
+// try_enqueue 只使用已有块，满了返回 false；enqueue 允许扩容
+void test_capacity() {
+    sq::ReaderWriterQueue<int> queue(7);  // 单个 8 槽位的块，可用 7 个
+    size_t capacity = queue.max_capacity();
+
+    int pushed = 0;
+    while (queue.try_enqueue(pushed)) ++pushed;
+    if (static_cast<size_t>(pushed) != capacity || queue.size_approx() != capacity || queue.max_capacity() != capacity) {
+        std::cout << "try_enqueue allocated or lost capacity" << std::endl;
+        std::abort();
+    }
+
+    queue.enqueue(pushed++);
+    if (queue.max_capacity() <= capacity || queue.size_approx() != static_cast<size_t>(pushed)) {
+        std::cout << "enqueue did not grow the queue" << std::endl;
+        std::abort();
+    }
+
+    int item;
+    for (int i = 0; i < pushed; ++i) {
+        if (!queue.try_dequeue(item) || item != i) {
+            std::cout << "Capacity order mismatch at " << i << std::endl;
+            std::abort();
+        }
+    }
+    std::cout << "Capacity test passed: initial " << capacity << ", grown " << queue.max_capacity() << std::endl;
+}
+
+// 突发之后收缩：取空后释放多余的块，队列之后仍能正常扩容与出入队
+void test_shrink() {
+    sq::ReaderWriterQueue<int, 64> queue(16);
+    size_t initial = queue.max_capacity();
+
+    int item;
+    for (int round = 0; round < 3; ++round) {
+        for (int i = 0; i < 10000; ++i) queue.enqueue(i);
+        size_t grown = queue.max_capacity();
+        for (int i = 0; i < 10000; ++i) {
+            if (!queue.try_dequeue(item) || item != i) {
+                std::cout << "Shrink order mismatch at " << i << std::endl;
+                std::abort();
+            }
+        }
+
+        size_t shrunk = queue.shrink_to(initial);
+        if (shrunk >= grown || shrunk != queue.max_capacity() || queue.size_approx() != 0) {
+            std::cout << "shrink_to did not release drained blocks" << std::endl;
+            std::abort();
+        }
+        std::cout << "Shrink round " << round << ": " << grown << " -> " << shrunk << std::endl;
+    }
+
+    // 生产者在消费者并发出队时反复收缩
+    const int items = 200000;
+    std::thread producer_thread([&queue, items]() {
+        for (int i = 0; i < items; ++i) {
+            queue.enqueue(i);
+            if (i % 5000 == 0) queue.shrink_to(0);
+        }
+    });
+    std::thread consumer_thread([&queue, items]() {
+        int value;
+        for (int i = 0; i < items; ++i) {
+            while (!queue.try_dequeue(value)) {}
+            if (value != i) {
+                std::cout << "Concurrent shrink order mismatch: " << value << " != " << i << std::endl;
+                std::abort();
+            }
+        }
+    });
+    producer_thread.join();
+    consumer_thread.join();
+    std::cout << "Concurrent shrink passed, capacity " << queue.max_capacity() << std::endl;
+}
+
+// 预留容量：reserve_capacity 之后 n 次 try_enqueue 都不需要分配，预热分配器让缺页提前发生
+void test_reserve_capacity(size_t n) {
+    sq::ReaderWriterQueue<int, 512, sq::DefaultOrdering, sq::PrefaultAllocator<>> queue(15);
+    queue.enqueue(-1);
+    int item;
+    queue.try_dequeue(item);
+
+    if (!queue.reserve_capacity(n) || queue.max_capacity() < n) {
+        std::cout << "reserve_capacity did not link enough blocks" << std::endl;
+        std::abort();
+    }
+    size_t reserved = queue.max_capacity();
+    if (!queue.reserve_capacity(n) || queue.max_capacity() != reserved) {
+        std::cout << "reserve_capacity allocated again although capacity was sufficient" << std::endl;
+        std::abort();
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        if (!queue.try_enqueue(static_cast<int>(i))) {
+            std::cout << "try_enqueue failed after reserve_capacity at " << i << std::endl;
+            std::abort();
+        }
+    }
+    for (size_t i = 0; i < n; ++i) {
+        if (!queue.try_dequeue(item) || item != static_cast<int>(i)) {
+            std::cout << "Reserve capacity order mismatch at " << i << std::endl;
+            std::abort();
+        }
+    }
+    std::cout << "Reserve capacity passed, capacity " << reserved << std::endl;
+}
+
+// 自定义块分配器：大页与 NUMA 绑定的块上做一轮跨块、扩容与收缩
+template<typename Allocator>
+void test_allocator(const char* name, const Allocator& allocator) {
+    sq::ReaderWriterQueue<int, 1024, sq::DefaultOrdering, Allocator> queue(2000, allocator);
+    for (int i = 0; i < 50000; ++i) queue.enqueue(i);
+
+    int item;
+    for (int i = 0; i < 50000; ++i) {
+        if (!queue.try_dequeue(item) || item != i) {
+            std::cout << name << " order mismatch at " << i << std::endl;
+            std::abort();
+        }
+    }
+    queue.shrink_to(0);
+    std::cout << name << " test passed, capacity " << queue.max_capacity() << std::endl;
+}
+
+// 原地构造与原地读取：emplace、reserve/commit、peek/pop
+struct Message {
+    Message(int _id, std::string _payload) : id(_id), payload(std::move(_payload)) {}
+    int id;
+    std::string payload;
+};
+
+template<typename Ordering = sq::DefaultOrdering>
+void test_in_place(int items) {
+    sq::ReaderWriterQueue<Message, 512, Ordering> queue(4);
+
+    std::thread producer_thread([&queue, items]() {
+        for (int i = 0; i < items; ++i) {
+            if (i % 2 == 0) {
+                queue.emplace(i, std::to_string(i));
+            } else {
+                Message* slot = queue.reserve();
+                new (slot) Message(i, std::to_string(i));
+                queue.commit();
+            }
+        }
+    });
+
+    std::thread consumer_thread([&queue, items]() {
+        for (int i = 0; i < items; ++i) {
+            Message* front;
+            while ((front = queue.peek()) == nullptr) {}
+            if (front->id != i || front->payload != std::to_string(i)) {
+                std::cout << "In-place order mismatch: " << front->id << " != " << i << std::endl;
+                std::abort();
+            }
+            queue.pop();
+        }
+    });
+
+    producer_thread.join();
+    consumer_thread.join();
+    std::cout << "In-place test passed (" << ordering_name<Ordering>() << "): " << items << " items" << std::endl;
+}
+
+// 先自旋，长时间拿不到再让出 CPU，避免单核机器上两个自旋线程互相饿死
+template<typename Queue>
+void spin_dequeue(Queue& queue, int& value) {
+    for (int spins = 0; !queue.try_dequeue(value); ++spins) {
+        if (spins < 4096) sq::cpu_relax();
+        else std::this_thread::yield();
+    }
+}
+
+// 跨线程 ping-pong：两个队列来回传递一个计数，统计平均往返时间
+template<typename Ordering = sq::DefaultOrdering>
+void test_ping_pong(int round_trips) {
+    sq::ReaderWriterQueue<int, 512, Ordering> ping(64), pong(64);
+
+    std::thread echo_thread([&ping, &pong, round_trips]() {
+        int value;
+        for (int i = 0; i < round_trips; ++i) {
+            spin_dequeue(ping, value);
+            pong.try_enqueue(value);
+        }
+    });
+
+    auto start = std::chrono::high_resolution_clock::now();
+    int value;
+    for (int i = 0; i < round_trips; ++i) {
+        ping.try_enqueue(i);
+        spin_dequeue(pong, value);
+        if (value != i) {
+            std::cout << "Ping-pong mismatch: " << value << " != " << i << std::endl;
+            std::abort();
+        }
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    echo_thread.join();
+
+    auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    std::cout << "Ping-pong round trip (" << ordering_name<Ordering>() << "): " << duration / round_trips << " ns" << std::endl;
+}
+
+// 阻塞队列：消费者在空队列上睡眠等待，生产者间歇性入队
+void test_blocking(int items) {
+    sq::BlockingReaderWriterQueue<int> queue(8);
+
+    int item;
+    if (queue.wait_dequeue_timed(item, std::chrono::milliseconds(10))) {
+        std::cout << "Timed wait on empty queue should fail" << std::endl;
+        std::abort();
+    }
+
+    std::thread producer_thread([&queue, items]() {
+        for (int i = 0; i < items; ++i) {
+            queue.enqueue(i);
+            if (i % 1000 == 0) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+
+    std::thread consumer_thread([&queue, items]() {
+        int value;
+        for (int i = 0; i < items; ++i) {
+            queue.wait_dequeue(value);
+            if (value != i) {
+                std::cout << "Blocking order mismatch: " << value << " != " << i << std::endl;
+                std::abort();
+            }
+        }
+    });
+
+    producer_thread.join();
+    consumer_thread.join();
+    std::cout << "Blocking test passed: " << items << " items, size_approx = " << queue.size_approx() << std::endl;
+}
+
+// 延迟发布：未 flush 的元素对消费者不可见；跨块、按包批量 flush 时顺序不变
+template<typename Ordering = sq::DefaultOrdering>
+void test_deferred_publish(int items) {
+    {
+        sq::ReaderWriterQueue<std::string> queue(4);
+        queue.set_publish_batch(8);
+        queue.enqueue("a");
+        queue.enqueue("b");
+        std::string value;
+        if (queue.try_dequeue(value)) {
+            std::cout << "Deferred element published too early" << std::endl;
+            std::abort();
+        }
+        queue.flush();
+        if (!queue.try_dequeue(value) || value != "a") std::abort();
+        queue.enqueue("c");  // 析构时仍未发布，也必须被销毁
+    }
+
+    sq::ReaderWriterQueue<int, 512, Ordering> queue(4);  // 小块，覆盖带着未发布元素切换块和扩容的路径
+    queue.set_publish_batch(32);
+
+    std::thread producer_thread([&queue, items]() {
+        for (int i = 0; i < items; ++i) {
+            queue.enqueue(i);
+            if (i % 100 == 99) queue.flush();  // 每个包结束时 flush
+        }
+        queue.flush();
+    });
+
+    std::thread consumer_thread([&queue, items]() {
+        int value;
+        for (int expected = 0; expected < items; ++expected) {
+            while (!queue.try_dequeue(value)) {}
+            if (value != expected) {
+                std::cout << "Deferred order mismatch: " << value << " != " << expected << std::endl;
+                std::abort();
+            }
+        }
+    });
+
+    producer_thread.join();
+    consumer_thread.join();
+    std::cout << "Deferred publish test passed (" << ordering_name<Ordering>() << "): " << items << " items" << std::endl;
+}
+
+// 编译期定长环：与 ReaderWriterQueue 相同的调用方式，覆盖单个/批量/预留三种入队路径和回绕
+template<typename Ordering = sq::DefaultOrdering>
+void test_fixed_ring(int items) {
+    sq::FixedRing<int, 256, Ordering> ring;
+
+    std::thread producer_thread([&ring, items]() {
+        int i = 0;
+        while (i < items) {
+            if (i % 3 == 0) {
+                int burst[8];
+                int n = std::min(8, items - i);
+                for (int k = 0; k < n; ++k) burst[k] = i + k;
+                if (ring.try_enqueue_bulk(burst, n)) i += n;
+            } else if (i % 3 == 1) {
+                if (int* slot = ring.try_reserve()) {
+                    new (slot) int(i++);
+                    ring.commit();
+                }
+            } else if (ring.try_enqueue(i)) {
+                ++i;
+            }
+        }
+    });
+
+    std::thread consumer_thread([&ring, items]() {
+        int out[16];
+        int expected = 0;
+        while (expected < items) {
+            size_t n = ring.try_dequeue_bulk(out, 16);
+            for (size_t k = 0; k < n; ++k, ++expected) {
+                if (out[k] != expected) {
+                    std::cout << "FixedRing order mismatch: " << out[k] << " != " << expected << std::endl;
+                    std::abort();
+                }
+            }
+            int value;
+            if (ring.peek() != nullptr && ring.try_dequeue(value)) {
+                if (value != expected++) {
+                    std::cout << "FixedRing order mismatch: " << value << std::endl;
+                    std::abort();
+                }
+            }
+        }
+    });
+
+    producer_thread.join();
+    consumer_thread.join();
+    std::cout << "FixedRing test passed (" << ordering_name<Ordering>() << "): " << items << " items, capacity = " << ring.max_capacity() << std::endl;
+}
+
+// 变长字节通道：长度不一的记录（含空记录）跨越回绕点传递，消费者逐字节校验
+void test_byte_channel(int records) {
+    sq::ByteChannel<> channel(4096);
+    auto fill = [](int i) {return static_cast<char>('a' + i % 26);};
+    auto length_of = [](int i) {return static_cast<size_t>(i * 37 % 300);};
+
+    std::thread producer_thread([&channel, records, fill, length_of]() {
+        for (int i = 0; i < records; ++i) {
+            size_t n = length_of(i);
+            char* dest;
+            for (int spins = 0; (dest = channel.try_reserve(n)) == nullptr; ++spins) {
+                if (spins >= 4096) std::this_thread::yield();
+            }
+            for (size_t k = 0; k < n; ++k) dest[k] = fill(i);
+            channel.commit(n);
+        }
+    });
+
+    std::thread consumer_thread([&channel, records, fill, length_of]() {
+        for (int i = 0; i < records; ++i) {
+            bool ok = true;
+            auto check = [&](std::string_view record) {
+                ok = record.size() == length_of(i) && record.find_first_not_of(fill(i)) == std::string_view::npos;
+            };
+            for (int spins = 0; !channel.try_consume(check); ++spins) {
+                if (spins >= 4096) std::this_thread::yield();
+            }
+            if (!ok) {
+                std::cout << "Byte channel record mismatch at " << i << std::endl;
+                std::abort();
+            }
+        }
+    });
+
+    producer_thread.join();
+    consumer_thread.join();
+    std::cout << "Byte channel test passed: " << records << " records, max record = " << channel.max_record_size() << std::endl;
+}
+
+// 等待策略：同一段生产者/消费者代码分别使用四种策略，SpinParkWait 需要生产者 notify
+template<typename Strategy>
+void test_wait_strategy(const char* name, Strategy&& strategy, int items) {
+    sq::ReaderWriterQueue<int> queue(16);
+
+    std::thread producer_thread([&queue, &strategy, items]() {
+        for (int i = 0; i < items; ++i) {
+            queue.enqueue(i);
+            strategy.notify();
+            if (i % 1000 == 0) std::this_thread::sleep_for(std::chrono::microseconds(100));  // 让消费者进入睡眠/退避
+        }
+    });
+
+    int value;
+    for (int expected = 0; expected < items; ++expected) {
+        queue.dequeue_wait(value, strategy);
+        if (value != expected) {
+            std::cout << name << " order mismatch: " << value << " != " << expected << std::endl;
+            std::abort();
+        }
+    }
+    producer_thread.join();
+    std::cout << "Wait strategy " << name << " passed: " << items << " items" << std::endl;
+}
+
+#if SQ_HAS_COROUTINES
+// 最简单的协程类型：立即开始执行，结束时自行销毁
+struct DetachedTask {
+    struct promise_type {
+        DetachedTask get_return_object() {return {};}
+        std::suspend_never initial_suspend() noexcept {return {};}
+        std::suspend_never final_suspend() noexcept {return {};}
+        void return_void() {}
+        void unhandled_exception() {std::terminate();}
+    };
+};
+
+DetachedTask await_consumer(sq::AwaitableReaderWriterQueue<int>& queue, int items, std::atomic<int>& finished) {
+    for (int expected = 0; expected < items; ++expected) {
+        int value = co_await queue.dequeue();
+        if (value != expected) {
+            std::cout << "Awaitable order mismatch: " << value << " != " << expected << std::endl;
+            std::abort();
+        }
+    }
+    finished.fetch_add(1, std::memory_order_release);
+}
+
+// 协程出队：一个线程上挂着上百个消费者协程，生产者轮流向各个队列入队并恢复等待的协程
+void test_awaitable(int queues, int items) {
+    std::vector<std::unique_ptr<sq::AwaitableReaderWriterQueue<int>>> channels;
+    for (int q = 0; q < queues; ++q) channels.push_back(std::make_unique<sq::AwaitableReaderWriterQueue<int>>(4));
+
+    std::atomic<int> finished{0};
+    for (int q = 0; q < queues; ++q) await_consumer(*channels[q], items, finished);
+
+    std::thread producer_thread([&channels, items]() {
+        for (int i = 0; i < items; ++i) {
+            for (auto& channel : channels) channel->enqueue(i);
+        }
+    });
+    producer_thread.join();
+
+    if (finished.load(std::memory_order_acquire) != queues) {
+        std::cout << "Awaitable consumers did not finish" << std::endl;
+        std::abort();
+    }
+    std::cout << "Awaitable test passed: " << queues << " queues x " << items << " items" << std::endl;
+}
+#endif
+
+// 扇入队列：多个生产者各自登记通道，消费者批量轮询，检查每个生产者内部的顺序
+void test_fan_in(int producers, int items) {
+    sq::FanInQueue<std::pair<int, int>> queue(16, 32);
+
+    std::vector<std::thread> producer_threads;
+    for (int p = 0; p < producers; ++p) {
+        producer_threads.emplace_back([&queue, p, items]() {
+            for (int i = 0; i < items; ++i) queue.enqueue(std::make_pair(p, i));
+        });
+    }
+
+    std::vector<int> expected(producers, 0);
+    std::vector<std::pair<int, int>> out(64);
+    for (long remaining = static_cast<long>(producers) * items; remaining > 0;) {
+        size_t n = queue.try_dequeue_bulk(out.begin(), out.size());
+        if (n == 0) std::this_thread::yield();
+        for (size_t k = 0; k < n; ++k, --remaining) {
+            auto [p, i] = out[k];
+            if (i != expected[p]++) {
+                std::cout << "Fan-in order mismatch on lane " << p << ": " << i << std::endl;
+                std::abort();
+            }
+        }
+    }
+
+    for (auto& t : producer_threads) t.join();
+    std::pair<int, int> extra;
+    // 所有生产者都已退出，这次出队把取空的通道全部回收
+    if (queue.try_dequeue(extra) || queue.lane_count() != 0) std::abort();
+
+    // 先后出现的生产者线程比槽位多：退出并取空后的槽位要能给新线程复用
+    sq::FanInQueue<int, 4> small;
+    for (int round = 0; round < 4 * 8; ++round) {
+        std::thread([&small, round]() {
+            for (int i = 0; i < 100; ++i) small.enqueue(round * 100 + i);
+        }).join();
+        int value;
+        for (int i = 0; i < 100; ++i) {
+            if (!small.try_dequeue(value) || value != round * 100 + i) {
+                std::cout << "Fan-in lane reuse mismatch in round " << round << std::endl;
+                std::abort();
+            }
+        }
+        if (small.try_dequeue(value) || small.lane_count() != 0) {
+            std::cout << "Fan-in lane not reclaimed in round " << round << std::endl;
+            std::abort();
+        }
+    }
+    std::cout << "Fan-in test passed: " << producers << " producers x " << items << " items" << std::endl;
+}
+
+#if SQ_ENABLE_STATS
+// 统计计数器：先在单线程下核对各项计数，再在并发读写时检查快照的一致性
+void test_stats(int items) {
+    sq::ReaderWriterQueue<int> queue(4);
+    for (int i = 0; i < 100; ++i) queue.enqueue(i);
+    sq::QueueStats filled = queue.stats();
+    int value;
+    while (queue.try_dequeue(value)) {}
+    sq::QueueStats drained = queue.stats();
+    if (filled.enqueued != 100 || filled.highWaterMark != 100 || filled.blocksAllocated < 2 || filled.tailBlockFull == 0 ||
+        filled.capacity < 100 || drained.dequeued != 100 || drained.blockHops == 0) {
+        std::cout << "Stats mismatch: enqueued " << filled.enqueued << ", high water " << filled.highWaterMark
+                  << ", blocks " << filled.blocksAllocated << ", hops " << drained.blockHops << std::endl;
+        std::abort();
+    }
+
+    std::atomic<bool> done{false};
+    std::thread reader_thread([&queue, &done]() {
+        size_t last = 0;
+        while (!done.load(std::memory_order_acquire)) {
+            sq::QueueStats snapshot = queue.stats();
+            if (snapshot.dequeued > snapshot.enqueued || snapshot.enqueued < last) {
+                std::cout << "Inconsistent stats snapshot " << snapshot.dequeued << " " << snapshot.enqueued << " " << last << std::endl;
+                std::abort();
+            }
+            last = snapshot.enqueued;
+            std::this_thread::yield();
+        }
+    });
+    std::thread producer_thread([&queue, items]() {
+        for (int i = 0; i < items; ++i) queue.enqueue(i);
+    });
+    for (int i = 0; i < items; ++i) spin_dequeue(queue, value);
+    producer_thread.join();
+    done.store(true, std::memory_order_release);
+    reader_thread.join();
+
+    sq::QueueStats final_stats = queue.stats();
+    std::cout << "Stats test passed: enqueued " << final_stats.enqueued << ", high water " << final_stats.highWaterMark
+              << ", blocks " << final_stats.blocksAllocated << ", capacity " << final_stats.capacity << std::endl;
+}
+#endif
+
+// 排空回调：消费者每次只处理一个快照，在元素原地调用回调，跨块时顺序不变；FixedRing 同样支持
+template<typename Queue>
+void test_consume_all(const char* name, Queue& queue, int items) {
+    std::thread producer_thread([&queue, items]() {
+        for (int i = 0; i < items; ++i) {
+            for (int spins = 0; !queue.try_enqueue(i); ++spins) {
+                if (spins >= 4096) std::this_thread::yield();
+            }
+        }
+    });
+
+    int expected = 0;
+    auto check = [&expected](int& value) {
+        if (value != expected++) {
+            std::cout << "consume_all order mismatch: " << value << std::endl;
+            std::abort();
+        }
+    };
+    while (expected < items) {
+        size_t n = expected % 2 == 0 ? queue.consume_all(check) : queue.consume_up_to(7, check);
+        if (n == 0) std::this_thread::yield();
+    }
+    producer_thread.join();
+    std::cout << "consume_all test passed (" << name << "): " << items << " items" << std::endl;
+}
+
+// 移动赋值遇到 "9" 时抛出异常，用来检查批量出队的异常安全
+struct ThrowOnNine {
+    std::string value;
+
+    ThrowOnNine() = default;
+    explicit ThrowOnNine(std::string v) : value(std::move(v)) {}
+    ThrowOnNine(ThrowOnNine&&) = default;
+    ThrowOnNine& operator=(ThrowOnNine&& other) {
+        if (other.value == "9") throw std::runtime_error("move failed");
+        value = std::move(other.value);
+        return *this;
+    }
+};
+
+// 回调或移动赋值抛出异常：已处理的元素出队，抛出异常的元素及之后的元素仍按顺序留在队列里（ASan 下检查没有读到已析构的槽位）
+template<typename StringQueue, typename FragileQueue>
+void test_consume_throw(const char* name, StringQueue& strings, FragileQueue& fragile) {
+    for (int i = 0; i < 20; ++i) {
+        strings.enqueue(std::string(32, 'a') + std::to_string(i));
+        fragile.enqueue(ThrowOnNine(std::to_string(i)));
+    }
+
+    int seen = 0;
+    bool thrown = false;
+    try {
+        strings.consume_all([&seen](std::string&) {
+            if (seen == 9) throw std::runtime_error("callback failed");
+            ++seen;
+        });
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+
+    std::vector<ThrowOnNine> out(20);
+    bool bulkThrown = false;
+    try {
+        fragile.try_dequeue_bulk(out.begin(), out.size());
+    } catch (const std::runtime_error&) {
+        bulkThrown = true;
+    }
+    if (!thrown || !bulkThrown || seen != 9 || out[8].value != "8") {
+        std::cout << "Throwing consumer test setup failed (" << name << ")" << std::endl;
+        std::abort();
+    }
+
+    std::string value;
+    ThrowOnNine item;
+    for (int i = 9; i < 20; ++i) {
+        if (!strings.try_dequeue(value) || value != std::string(32, 'a') + std::to_string(i)) {
+            std::cout << "Element lost after throwing callback (" << name << ") at " << i << std::endl;
+            std::abort();
+        }
+        if (i == 9) {
+            fragile.pop();  // "9" 每次移动都会抛出，直接丢弃
+            continue;
+        }
+        if (!fragile.try_dequeue(item) || item.value != std::to_string(i)) {
+            std::cout << "Element lost after throwing move (" << name << ") at " << i << std::endl;
+            std::abort();
+        }
+    }
+    if (strings.try_dequeue(value) || fragile.try_dequeue(item)) {
+        std::cout << "Queue should be empty after throwing consumer test (" << name << ")" << std::endl;
+        std::abort();
+    }
+    std::cout << "Throwing consumer test passed (" << name << ")" << std::endl;
+}
+
+// 跨进程队列：子进程通过继承的 memfd 重新映射（地址不同）后作为消费者，父进程作为生产者；
+// 另外在同一进程内用两个 shm_open 映射检查具名队列
+void test_shared_memory(int items) {
+    struct Order {
+        long id;
+        double price;
+        char symbol[8];
+    };
+
+    auto producer_side = sq::SharedMemoryQueue<Order>::create("sq-test", 2000);  // 多个块，覆盖跨块路径
+    pid_t pid = fork();
+    if (pid == 0) {
+        auto consumer_side = sq::SharedMemoryQueue<Order>::attach(dup(producer_side.get_fd()));
+        Order order{};
+        for (long expected = 0; expected < items; ++expected) {
+            for (int spins = 0; !consumer_side.try_dequeue(order); ++spins) {
+                if (spins >= 4096) std::this_thread::yield();
+            }
+            if (order.id != expected || order.price != expected * 0.5 || order.symbol[0] != 'A' + expected % 26) _exit(1);
+        }
+        _exit(consumer_side.size_approx() == 0 ? 0 : 1);
+    }
+
+    for (long i = 0; i < items; ++i) {
+        Order order{i, i * 0.5, {static_cast<char>('A' + i % 26)}};
+        for (int spins = 0; !producer_side.try_enqueue(order); ++spins) {
+            if (spins >= 4096) std::this_thread::yield();
+        }
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        std::cout << "Shared memory consumer failed" << std::endl;
+        std::abort();
+    }
+
+    const char* name = "/sq-test-named";
+    sq::SharedMemoryQueue<int>::unlink(name);
+    {
+        auto writer = sq::SharedMemoryQueue<int>::create_named(name, 10);
+        auto reader = sq::SharedMemoryQueue<int>::open_named(name);
+        int value = 0;
+        while (writer.try_enqueue(value)) ++value;  // 写满固定容量
+        if (static_cast<size_t>(value) < writer.max_capacity() - 1 || *reader.peek() != 0) std::abort();
+        for (int expected = 0; expected < value; ++expected) {
+            int out;
+            if (!reader.try_dequeue(out) || out != expected) std::abort();
+        }
+        if (reader.pop()) std::abort();
+    }
+    sq::SharedMemoryQueue<int>::unlink(name);
+    std::cout << "Shared memory test passed: " << items << " items across processes" << std::endl;
+}
+
+// 对端篡改共享内存：换块时块状态不符合协议、头部的块偏移越界时操作抛出异常，几何不一致时拒绝打开。
+// 偏移按 ShmQueue.h 的布局写死：头部 3 个缓存行（frontBlock 在 64，tailBlock 在 128），每个块 2 个缓存行（tail 在块内 64 处）
+void test_shared_memory_corruption() {
+    auto queue = sq::SharedMemoryQueue<int, 16>::create("sq-corrupt", 100);
+    auto peer = sq::SharedMemoryQueue<int, 16>::attach(dup(queue.get_fd()));
+    struct stat st{};
+    fstat(queue.get_fd(), &st);
+    auto raw = static_cast<char*>(mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, queue.get_fd(), 0));
+    if (raw == MAP_FAILED) std::abort();
+    auto word = [raw](size_t offset) -> std::uint64_t& {return *reinterpret_cast<std::uint64_t*>(raw + offset);};
+
+    auto block = [](size_t index) {return 192 + index * 128;};
+    auto rejects = [](auto&& operation) {
+        try {
+            operation();
+        } catch (const std::system_error& e) {
+            return e.code().value() == EBADMSG;
+        }
+        return false;
+    };
+    int out;
+
+    // 生产者换到的下一个块不是空的
+    for (int i = 0; i < 15; ++i) {
+        if (!queue.try_enqueue(i)) std::abort();
+    }
+    word(block(1) + 64) = 5;
+    if (!rejects([&] {queue.try_enqueue(15);})) std::abort();
+    word(block(1) + 64) = 0;
+    if (!queue.try_enqueue(15)) std::abort();
+    for (int i = 0; i < 16; ++i) {
+        if (!peer.try_dequeue(out) || out != i) std::abort();
+    }
+
+    // tailBlock 指向前端块之后的空块，消费者换块后找不到元素
+    std::uint64_t tailBlock = word(128);
+    word(128) = block(2);
+    if (!rejects([&] {peer.try_dequeue(out);})) std::abort();
+    word(128) = tailBlock;
+
+    for (int round = 0; round < 3; ++round) {  // 跨过所有块
+        for (int i = 0; i < 90; ++i) {
+            if (!queue.try_enqueue(i)) std::abort();
+        }
+        for (int i = 0; i < 90; ++i) {
+            if (!peer.try_dequeue(out) || out != i) std::abort();
+        }
+    }
+    std::uint64_t frontBlock = word(64);
+    tailBlock = word(128);
+    word(128) = 1ULL << 40;
+    if (!rejects([&] {queue.try_enqueue(1);})) std::abort();
+    word(128) = tailBlock;
+    word(64) = frontBlock + 8;  // 落在块内部而不是块起点
+    if (!rejects([&] {peer.try_dequeue(out);}) || !rejects([&] {peer.peek();}) || !rejects([&] {static_cast<void>(peer.size_approx());}))
+        std::abort();
+    word(64) = frontBlock;
+    if (!queue.try_enqueue(7) || !peer.try_dequeue(out) || out != 7) std::abort();
+
+    auto attach_fails = [&queue] {
+        try {
+            sq::SharedMemoryQueue<int, 16>::attach(dup(queue.get_fd()));
+        } catch (const std::system_error& e) {
+            return e.code().value() == EINVAL;
+        }
+        return false;
+    };
+    std::uint64_t blockSize = word(24);
+    word(24) = 3;  // 不是 2 的幂
+    if (!attach_fails()) std::abort();
+    word(24) = blockSize * 2;  // 与映射大小不符
+    if (!attach_fails()) std::abort();
+    word(24) = blockSize;
+    word(16) = 1ULL << 62;  // 乘法溢出
+    if (!attach_fails()) std::abort();
+
+    munmap(raw, st.st_size);
+    std::cout << "Shared memory corruption test passed" << std::endl;
+}
+
+// 可平凡复制的元素：批量接口走 memcpy，块内回绕时拆成两段；用不同批量大小让起点落在块内各个位置
+void test_trivial_bulk() {
+    struct Tick {
+        long seq;
+        double price;
+    };
+    static_assert(sq::Block<Tick>::trivial_element);
+
+    sq::ReaderWriterQueue<Tick, 16> queue(40);  // 多个 16 槽的块
+    Tick in[37], out[37];
+    long next_in = 0, next_out = 0;
+    for (int round = 0; round < 2000; ++round) {
+        size_t n = 1 + round % 37;
+        for (size_t k = 0; k < n; ++k) in[k] = Tick{next_in + static_cast<long>(k), 0.25 * (next_in + k)};
+        if (queue.try_enqueue_bulk(in, n)) next_in += static_cast<long>(n);
+
+        size_t got = queue.try_dequeue_bulk(out, 1 + (round * 7) % 37);
+        for (size_t k = 0; k < got; ++k, ++next_out) {
+            if (out[k].seq != next_out || out[k].price != 0.25 * next_out) {
+                std::cout << "Trivial bulk mismatch: " << out[k].seq << " != " << next_out << std::endl;
+                std::abort();
+            }
+        }
+    }
+    std::cout << "Trivial bulk test passed: " << next_out << " items" << std::endl;
+}
+
 int main() {
     const int items_to_produce = 100;
 
@@ -39,6 +879,78 @@ int main() {
     producer_thread.join();
     consumer_thread.join();
 
+    test_bulk(1000000);
+    test_bulk<sq::AcquireReleaseOrdering>(1000000);
+    test_trivial_bulk();
+    test_capacity();
+    test_shrink();
+    test_reserve_capacity(100000);
+    test_allocator("HugePageBlockAllocator", sq::HugePageBlockAllocator());
+    {
+        // 几百个 2KB 的小块应当共用同一个 2MB 区域，而不是每块各占一个大页
+        sq::HugePageBlockAllocator allocator;
+        sq::ReaderWriterQueue<int, 512, sq::DefaultOrdering, sq::HugePageBlockAllocator> queue(100000, allocator);
+        queue.shrink_to(0);
+        for (int i = 0; i < 100000; ++i) queue.enqueue(i);  // 收缩释放的块从空闲链表重新取回
+        if (allocator.arena_count() != 1) {
+            std::cout << "HugePageBlockAllocator used " << allocator.arena_count() << " arenas for small blocks" << std::endl;
+            std::abort();
+        }
+    }
+    test_allocator("NumaBlockAllocator", sq::NumaBlockAllocator(sq::NumaBlockAllocator::current_node()));
+    test_in_place(100000);
+    test_in_place<sq::AcquireReleaseOrdering>(100000);
+    test_ping_pong(1000);
+    test_ping_pong<sq::AcquireReleaseOrdering>(1000);
+    test_blocking(100000);
+    test_fixed_ring(100000);
+    test_fixed_ring<sq::AcquireReleaseOrdering>(100000);
+    test_deferred_publish(100000);
+    test_deferred_publish<sq::AcquireReleaseOrdering>(100000);
+    test_byte_channel(20000);
+    test_wait_strategy("BusySpinWait", sq::BusySpinWait(), 20000);
+    test_wait_strategy("SpinYieldWait", sq::SpinYieldWait(), 100000);
+    test_wait_strategy("BackoffWait", sq::BackoffWait(), 100000);
+    {
+        // 超过一秒的退避要拆成 tv_sec 和 tv_nsec，否则 nanosleep 报 EINVAL
+        timespec ts = sq::BackoffWait::to_timespec(std::chrono::microseconds(2000250));
+        if (ts.tv_sec != 2 || ts.tv_nsec != 250000) {
+            std::cout << "BackoffWait sleep split wrong: " << ts.tv_sec << "s " << ts.tv_nsec << "ns" << std::endl;
+            std::abort();
+        }
+    }
+    test_wait_strategy("SpinParkWait", sq::SpinParkWait(), 100000);
+#if SQ_HAS_COROUTINES
+    test_awaitable(200, 1000);
+#endif
+    test_fan_in(8, 100000);
+    test_shared_memory(200000);
+    test_shared_memory_corruption();
+    {
+        sq::ReaderWriterQueue<int> queue(4);
+        for (int i = 0; i < 1000; ++i) queue.enqueue(i);  // 先扩出一串小块，再覆盖跨块排空
+        int discarded = 0;
+        if (queue.consume_all([&discarded](int&) {++discarded;}) != 1000 || discarded != 1000) std::abort();
+        test_consume_all("ReaderWriterQueue", queue, 200000);
+        sq::FixedRing<int, 64> ring;
+        test_consume_all("FixedRing", ring, 200000);
+        sq::ReaderWriterQueue<int, 512, sq::AcquireReleaseOrdering> acqRelQueue(4);
+        test_consume_all("ReaderWriterQueue acq_rel", acqRelQueue, 200000);
+        sq::FixedRing<int, 64, sq::AcquireReleaseOrdering> acqRelRing;
+        test_consume_all("FixedRing acq_rel", acqRelRing, 200000);
+    }
+    {
+        sq::ReaderWriterQueue<std::string, 4> strings(4);  // 4 槽位的小块，异常发生在跨块之后
+        sq::ReaderWriterQueue<ThrowOnNine, 4> fragile(4);
+        test_consume_throw("ReaderWriterQueue", strings, fragile);
+        sq::FixedRing<std::string, 32> stringRing;
+        sq::FixedRing<ThrowOnNine, 32> fragileRing;
+        test_consume_throw("FixedRing", stringRing, fragileRing);
+    }
+#if SQ_ENABLE_STATS
+    test_stats(100000);
+#endif
+
     std::cout << "Test completed successfully!" << std::endl;
 
     return 0;